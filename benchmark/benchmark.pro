@@ -0,0 +1,20 @@
+QT       += core gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = filtering-benchmark
+
+include(../processing.pri)
+
+SOURCES += \
+    main.cpp \
+    referencefilters.cpp
+
+HEADERS += \
+    referencefilters.h
+
+OBJECTS_DIR = obj
+MOC_DIR = obj
+RCC_DIR = obj
+UI_DIR = obj
@@ -0,0 +1,678 @@
+#include "imageprocessor.h"
+#include "convolutionkernels.h"
+#include "filterconstants.h"
+#include "filteroperation.h"
+#include "filterpipeline.h"
+#include "referencefilters.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QString>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+using Filter = std::function<QImage(const QImage &)>;
+
+struct BenchmarkCase
+{
+    QString name;
+    Filter reference;
+    Filter optimized;
+};
+
+struct BenchmarkResult
+{
+    QString name;
+    int width;
+    int height;
+    int runs;
+    double bestMs;
+    double medianMs;
+
+    double megapixels() const { return width * static_cast<double>(height) / 1e6; }
+    double megapixelsPerSecond() const { return megapixels() / (bestMs / 1000.0); }
+};
+
+static QImage makeSyntheticImage(int width, int height)
+{
+    QImage image(width, height, QImage::Format_RGB32);
+    quint32 state = 0x9e3779b9u;
+    for (int y = 0; y < height; ++y)
+    {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; ++x)
+        {
+            state = state * 1664525u + 1013904223u;
+            int noise = static_cast<int>(state >> 26) - 32;
+            line[x] = qRgb(qBound(0, x * 255 / width + noise, 255),
+                           qBound(0, y * 255 / height - noise, 255),
+                           static_cast<int>(state >> 24));
+        }
+    }
+    return image;
+}
+
+// 4:3 image of about the given number of megapixels.
+static QSize sizeForMegapixels(double megapixels)
+{
+    const int width = qMax(1, static_cast<int>(std::lround(std::sqrt(megapixels * 1e6 * 4.0 / 3.0))));
+    const int height = qMax(1, static_cast<int>(std::lround(megapixels * 1e6 / width)));
+    return QSize(width, height);
+}
+
+static bool samePixels(const QImage &a, const QImage &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (int y = 0; y < a.height(); ++y)
+    {
+        for (int x = 0; x < a.width(); ++x)
+        {
+            if (a.pixel(x, y) != b.pixel(x, y))
+                return false;
+        }
+    }
+    return true;
+}
+
+// Runs filter the given number of times and returns every run in
+// milliseconds, sorted.
+static QVector<double> timeRuns(const Filter &filter, const QImage &input, QImage &output, int runs)
+{
+    QVector<double> times;
+    for (int i = 0; i < runs; ++i)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        output = filter(input);
+        times.append(timer.nsecsElapsed() / 1e6);
+    }
+    std::sort(times.begin(), times.end());
+    return times;
+}
+
+// Picks the whole-image overload of a filter that also has in-place or region
+// ones.
+static Filter copying(QImage (*filter)(const QImage &))
+{
+    return filter;
+}
+
+// Runs filter with the given number of filter threads and restores the
+// previous count, so the in-place cases see one band and several.
+static Filter withThreads(int threads, const Filter &filter)
+{
+    return [threads, filter](const QImage &image)
+    {
+        const int previous = ImageProcessor::threadCount();
+        ImageProcessor::setThreadCount(threads);
+        QImage result = filter(image);
+        ImageProcessor::setThreadCount(previous);
+        return result;
+    };
+}
+
+// A disc of the given odd diameter in a square kernel: neither separable
+// nor a box, so it runs directly or through FFT tiles.
+static Kernel discKernel(int size)
+{
+    const int radius = size / 2;
+    QVector<QVector<int>> disc(size, QVector<int>(size));
+    int discSum = 0;
+    for (int r = 0; r < size; ++r)
+    {
+        for (int c = 0; c < size; ++c)
+        {
+            disc[r][c] = (r - radius) * (r - radius) + (c - radius) * (c - radius) <= radius * radius ? 1 : 0;
+            discSum += disc[r][c];
+        }
+    }
+    return Kernel(size, size, disc, discSum, 0, radius, radius);
+}
+
+// Rectangles of an image of the given size for the region cases: one
+// touching each edge, one at an odd offset so dithering has to realign its
+// threshold map, and the whole image.
+struct RegionRect
+{
+    const char *name;
+    QRect (*rect)(const QSize &size);
+};
+
+static const RegionRect regionRects[] = {
+    {"top-left", [](const QSize &size)
+     { return QRect(0, 0, size.width() / 3, size.height() / 4); }},
+    {"right", [](const QSize &size)
+     { return QRect(size.width() - size.width() / 4, size.height() / 3, size.width() / 4, size.height() / 5); }},
+    {"bottom", [](const QSize &size)
+     { return QRect(size.width() / 5, size.height() - 7, size.width() / 2, 7); }},
+    {"odd offset", [](const QSize &size)
+     { return QRect(5, 3, size.width() / 2 + 1, size.height() / 2 + 1); }},
+    {"whole image", [](const QSize &size)
+     { return QRect(QPoint(0, 0), size); }}};
+
+static QVector<BenchmarkCase> makeCases()
+{
+    QVector<BenchmarkCase> cases = {
+        {"invertColors", &ReferenceFilters::invertColors, copying(&ImageProcessor::invertColors)},
+        {"adjustBrightness", &ReferenceFilters::adjustBrightness, copying(&ImageProcessor::adjustBrightness)},
+        {"adjustContrast", &ReferenceFilters::adjustContrast, copying(&ImageProcessor::adjustContrast)},
+        {"gammaCorrection", &ReferenceFilters::gammaCorrection, copying(&ImageProcessor::gammaCorrection)},
+        {"brightness+contrast+gamma", [](const QImage &image)
+         { return ReferenceFilters::gammaCorrection(ReferenceFilters::adjustContrast(ReferenceFilters::adjustBrightness(image))); },
+         [](const QImage &image)
+         {
+             return ImageProcessor::applyLookupTable(image, ImageProcessor::brightnessTable()
+                                                                .then(ImageProcessor::contrastTable())
+                                                                .then(ImageProcessor::gammaTable()));
+         }},
+        {"greyscale", &ReferenceFilters::applyGreyscaleFilter, copying(&ImageProcessor::applyGreyscaleFilter)},
+    };
+
+    QVector<QPair<QString, Kernel>> kernels;
+    for (const char *name : {"blur", "gaussian_blur", "sharpen", "edge_detection", "emboss"})
+        kernels.append({name, FilterOperation::predefinedKernel(name)});
+
+    for (int size : {7, 15, 31})
+        kernels.append({QString("disc %1x%2").arg(size).arg(size), discKernel(size)});
+    kernels.append({"box 9x9", Kernel(9, 9, QVector<QVector<int>>(9, QVector<int>(9, 1)), 81, 0, 4, 4)});
+    kernels.append({"box 25x25", FilterOperation::parse("box:25").convolutionKernel()});
+
+    for (const QPair<QString, Kernel> &entry : kernels)
+    {
+        const Kernel kernel = entry.second;
+        cases.append({"convolution " + entry.first, [kernel](const QImage &image)
+                      { return ReferenceFilters::applyConvolution(image, kernel); },
+                      [kernel](const QImage &image)
+                      { return ImageProcessor::applyConvolution(image, kernel); }});
+    }
+
+    for (int size = 3; size <= 15; size += 2)
+    {
+        cases.append({QString("median %1").arg(size), [size](const QImage &image)
+                      { return ReferenceFilters::applyMedianFilter(image, size); },
+                      [size](const QImage &image)
+                      { return ImageProcessor::applyMedianFilter(image, size); }});
+    }
+
+    // Planar variants, timed including the split and the repacking.
+    const Kernel gaussian = FilterOperation::predefinedKernel("gaussian_blur");
+    cases.append({"planar convolution gaussian_blur", [gaussian](const QImage &image)
+                  { return ReferenceFilters::applyConvolution(image, gaussian); },
+                  [gaussian](const QImage &image)
+                  { return ImageProcessor::applyConvolution(PlanarImage::fromImage(image), gaussian).toImage(); }});
+    cases.append({"planar median 5", [](const QImage &image)
+                  { return ReferenceFilters::applyMedianFilter(image, 5); },
+                  [](const QImage &image)
+                  { return ImageProcessor::applyMedianFilter(PlanarImage::fromImage(image), 5).toImage(); }});
+
+    // The in-place variants, which keep only the rows each band has
+    // overwritten (PixelAccess::filterInPlace). image.copy() hands them an
+    // unshared buffer they may overwrite; a shallow QImage(image) would
+    // make them copy. An off-centre anchor makes the halos above and below
+    // differ.
+    const Kernel disc = discKernel(9);
+    const Kernel offCentreDisc(9, 9, disc.getKernel(), disc.getSum(), 0, 2, 6);
+    const FilterPipeline medianPipeline(FilterOperation::parseChain("median:5,sharpen,median:7"));
+    for (int threads : {1, 4})
+    {
+        const QString suffix = QString(" (%1 thread%2)").arg(threads).arg(threads == 1 ? "" : "s");
+        cases.append({"in-place convolution disc 9x9 anchor 2,6" + suffix, [offCentreDisc](const QImage &image)
+                      { return ReferenceFilters::applyConvolution(image, offCentreDisc); },
+                      withThreads(threads, [offCentreDisc](const QImage &image)
+                                  { return ImageProcessor::applyConvolution(image.copy(), offCentreDisc); })});
+        cases.append({"in-place median 7" + suffix, [](const QImage &image)
+                      { return ReferenceFilters::applyMedianFilter(image, 7); },
+                      withThreads(threads, [](const QImage &image)
+                                  { return ImageProcessor::applyMedianFilter(image.copy(), 7); })});
+        cases.append({"in-place pipeline median:5,sharpen,median:7" + suffix, [](const QImage &image)
+                      {
+                          QImage result = ReferenceFilters::applyMedianFilter(image, 5);
+                          result = ReferenceFilters::applyConvolution(result, FilterOperation::predefinedKernel("sharpen"));
+                          return ReferenceFilters::applyMedianFilter(result, 7);
+                      },
+                      withThreads(threads, [medianPipeline](const QImage &image)
+                                  { return medianPipeline.apply(image.copy()); })});
+    }
+
+    // Strip filtering as cli --stream does it, in strips of 5 rows: far
+    // fewer than the chain's halo, and not a multiple of the threshold
+    // map, so the kept rows and the period alignment both matter.
+    QVector<QVector<int>> ramp(7, QVector<int>(7));
+    for (int r = 0; r < 7; ++r)
+    {
+        for (int c = 0; c < 7; ++c)
+            ramp[r][c] = (r + 2 * c) % 4 - 1;
+    }
+    const FilterPipeline stripPipeline({FilterOperation::median(5),
+                                        FilterOperation::convolution(Kernel(7, 7, ramp, 17, 20, 2, 4), "ramp 7x7"),
+                                        FilterOperation::orderedDithering(4, 4)});
+    cases.append({"strips median:5,ramp 7x7,dither:4:4", [stripPipeline](const QImage &image)
+                  { return stripPipeline.apply(image); },
+                  [stripPipeline](const QImage &image)
+                  {
+                      QImage result;
+                      int nextRow = 0;
+                      int nextWritten = 0;
+                      stripPipeline.applyStrips(
+                          image.height(), 5,
+                          [&](int rowCount)
+                          {
+                              const QImage rows = image.copy(QRect(0, nextRow, image.width(), rowCount));
+                              nextRow += rowCount;
+                              return rows;
+                          },
+                          [&](const QImage &rows, int firstRow, int rowCount)
+                          {
+                              if (result.isNull())
+                                  result = QImage(image.size(), rows.format());
+                              for (int y = 0; y < rowCount; ++y)
+                                  std::memcpy(result.scanLine(nextWritten + y), rows.constScanLine(firstRow + y), rows.bytesPerLine());
+                              nextWritten += rowCount;
+                          });
+                      return result;
+                  }});
+
+    // The other border modes on every convolution path and both median
+    // engines. The 31x31 disc and the 15x15 median run on a corner of the
+    // image smaller than their windows, so mirror reflects more than once.
+    QVector<QPair<QString, Kernel>> borderKernels = {
+        {"sharpen", FilterOperation::predefinedKernel("sharpen")},
+        {"gaussian_blur", gaussian},
+        {"box 9x9 off-centre", Kernel(9, 9, QVector<QVector<int>>(9, QVector<int>(9, 1)), 81, 0, 2, 6)},
+        {"disc 7x7", discKernel(7)}};
+    for (const Border &border : {Border(Border::Mode::Mirror), Border(Border::Mode::Wrap), Border(Border::Mode::Constant, 100)})
+    {
+        const QString suffix = " " + border.name();
+        for (const QPair<QString, Kernel> &entry : borderKernels)
+        {
+            Kernel kernel = entry.second;
+            kernel.setBorder(border);
+            cases.append({"convolution " + entry.first + suffix, [kernel, border](const QImage &image)
+                          { return ReferenceFilters::applyConvolution(image, kernel, border); },
+                          [kernel](const QImage &image)
+                          { return ImageProcessor::applyConvolution(image, kernel); }});
+        }
+
+        Kernel fftDisc = discKernel(9);
+        fftDisc.setBorder(border);
+        cases.append({"convolution disc 9x9 through FFT" + suffix, [fftDisc, border](const QImage &image)
+                      { return ReferenceFilters::applyConvolution(image, fftDisc, border); },
+                      [fftDisc](const QImage &image)
+                      {
+                          const int threshold = ImageProcessor::fftThreshold();
+                          ImageProcessor::setFftThreshold(0);
+                          QImage result = ImageProcessor::applyConvolution(image, fftDisc);
+                          ImageProcessor::setFftThreshold(threshold);
+                          return result;
+                      }});
+
+        Kernel wideDisc = discKernel(31);
+        wideDisc.setBorder(border);
+        cases.append({"convolution disc 31x31 on 16x16" + suffix, [wideDisc, border](const QImage &image)
+                      { return ReferenceFilters::applyConvolution(image.copy(QRect(0, 0, 16, 16)), wideDisc, border); },
+                      [wideDisc](const QImage &image)
+                      { return ImageProcessor::applyConvolution(image.copy(QRect(0, 0, 16, 16)), wideDisc); }});
+
+        Kernel planarGaussian = gaussian;
+        planarGaussian.setBorder(border);
+        cases.append({"planar convolution gaussian_blur" + suffix, [planarGaussian, border](const QImage &image)
+                      { return ReferenceFilters::applyConvolution(image, planarGaussian, border); },
+                      [planarGaussian](const QImage &image)
+                      { return ImageProcessor::applyConvolution(PlanarImage::fromImage(image), planarGaussian).toImage(); }});
+
+        for (int size : {3, 7})
+        {
+            cases.append({QString("median %1").arg(size) + suffix, [size, border](const QImage &image)
+                          { return ReferenceFilters::applyMedianFilter(image, size, border); },
+                          [size, border](const QImage &image)
+                          { return ImageProcessor::applyMedianFilter(image, size, border); }});
+        }
+        cases.append({"median 15 on 6x6" + suffix, [border](const QImage &image)
+                      { return ReferenceFilters::applyMedianFilter(image.copy(QRect(0, 0, 6, 6)), 15, border); },
+                      [border](const QImage &image)
+                      { return ImageProcessor::applyMedianFilter(image.copy(QRect(0, 0, 6, 6)), 15, border); }});
+        cases.append({"planar median 5" + suffix, [border](const QImage &image)
+                      { return ReferenceFilters::applyMedianFilter(image, 5, border); },
+                      [border](const QImage &image)
+                      { return ImageProcessor::applyMedianFilter(PlanarImage::fromImage(image), 5, border).toImage(); }});
+    }
+
+    // Local (constant) and whole-image (mirror, wrap) borders in one chain.
+    const FilterPipeline borderPipeline(FilterOperation::parseChain("blur:constant:0,sharpen:mirror,median:3:wrap"));
+    cases.append({"pipeline blur:constant:0,sharpen:mirror,median:3:wrap", [](const QImage &image)
+                  {
+                      QImage result = ReferenceFilters::applyConvolution(image, FilterOperation::predefinedKernel("blur"),
+                                                                         Border(Border::Mode::Constant, 0));
+                      result = ReferenceFilters::applyConvolution(result, FilterOperation::predefinedKernel("sharpen"),
+                                                                  Border(Border::Mode::Mirror));
+                      return ReferenceFilters::applyMedianFilter(result, 3, Border(Border::Mode::Wrap));
+                  },
+                  [borderPipeline](const QImage &image)
+                  { return borderPipeline.apply(image); }});
+
+    const Kernel blur = FilterOperation::predefinedKernel("blur");
+    const Kernel sharpen = FilterOperation::predefinedKernel("sharpen");
+    const Kernel emboss = FilterOperation::predefinedKernel("emboss");
+    const FilterPipeline pipeline(FilterOperation::parseChain("brightness,blur,sharpen,contrast,emboss"));
+    cases.append({"pipeline brightness,blur,sharpen,contrast,emboss", [blur, sharpen, emboss](const QImage &image)
+                  {
+                      QImage result = ReferenceFilters::adjustBrightness(image);
+                      result = ReferenceFilters::applyConvolution(result, blur);
+                      result = ReferenceFilters::applyConvolution(result, sharpen);
+                      result = ReferenceFilters::adjustContrast(result);
+                      return ReferenceFilters::applyConvolution(result, emboss);
+                  },
+                  [pipeline](const QImage &image)
+                  { return pipeline.apply(image); }});
+
+    cases.append({"ordered dithering 4/4", [](const QImage &image)
+                  { return ReferenceFilters::applyOrderedDithering(image, 4, DITHERING_QUANTIZATION_LEVEL); },
+                  [](const QImage &image)
+                  { return ImageProcessor::applyOrderedDithering(image, 4, DITHERING_QUANTIZATION_LEVEL); }});
+    cases.append({"uniform quantization 4/4/4", [](const QImage &image)
+                  { return ReferenceFilters::applyUniformQuantization(image, 4, 4, 4); },
+                  [](const QImage &image)
+                  { return ImageProcessor::applyUniformQuantization(image, 4, 4, 4); }});
+    cases.append({"HSV round trip", [](const QImage &image)
+                  {
+                      QImage hsv = ReferenceFilters::convertToHSV(image);
+                      return ReferenceFilters::convertHSVToRGB(ReferenceFilters::extractChannel(hsv, ReferenceFilters::Channel::H),
+                                                               ReferenceFilters::extractChannel(hsv, ReferenceFilters::Channel::S),
+                                                               ReferenceFilters::extractChannel(hsv, ReferenceFilters::Channel::V));
+                  },
+                  [](const QImage &image)
+                  {
+                      const ImageProcessor::HSVPlanes planes = ImageProcessor::splitHSV(image);
+                      return ImageProcessor::convertHSVToRGB(planes.h, planes.s, planes.v);
+                  }});
+
+    // Each region variant against the reference result for the whole image,
+    // cropped to the region.
+    QVector<QVector<int>> skewed(5, QVector<int>(7));
+    for (int r = 0; r < 5; ++r)
+    {
+        for (int c = 0; c < 7; ++c)
+            skewed[r][c] = (r * 7 + c) % 5 - 1;
+    }
+    const Kernel offCentre(5, 7, skewed, 9, 10, 1, 5);
+    const FilterPipeline regionPipeline(FilterOperation::parseChain("brightness,median:3,sharpen,dither:4:4"));
+    using RegionFilter = std::function<QImage(const QImage &image, const QRect &region)>;
+    const QVector<QPair<QString, QPair<Filter, RegionFilter>>> regionFilters = {
+        {"lookup brightness", {&ReferenceFilters::adjustBrightness, [](const QImage &image, const QRect &region)
+                               { return ImageProcessor::applyLookupTable(image, ImageProcessor::brightnessTable(), region); }}},
+        {"convolution off-centre 5x7", {[offCentre](const QImage &image)
+                                        { return ReferenceFilters::applyConvolution(image, offCentre); },
+                                        [offCentre](const QImage &image, const QRect &region)
+                                        { return ImageProcessor::applyConvolution(image, offCentre, region); }}},
+        {"median 5", {[](const QImage &image)
+                      { return ReferenceFilters::applyMedianFilter(image, 5); },
+                      [](const QImage &image, const QRect &region)
+                      { return ImageProcessor::applyMedianFilter(image, 5, region); }}},
+        {"ordered dithering 4/4", {[](const QImage &image)
+                                   { return ReferenceFilters::applyOrderedDithering(image, 4, DITHERING_QUANTIZATION_LEVEL); },
+                                   [](const QImage &image, const QRect &region)
+                                   { return ImageProcessor::applyOrderedDithering(image, 4, DITHERING_QUANTIZATION_LEVEL, region); }}},
+        {"greyscale", {&ReferenceFilters::applyGreyscaleFilter, [](const QImage &image, const QRect &region)
+                       { return ImageProcessor::applyGreyscaleFilter(image, region); }}},
+        {"pipeline brightness,median:3,sharpen,dither:4:4", {[](const QImage &image)
+                                                             {
+                                                                 QImage result = ReferenceFilters::adjustBrightness(image);
+                                                                 result = ReferenceFilters::applyMedianFilter(result, 3);
+                                                                 result = ReferenceFilters::applyConvolution(
+                                                                     result, FilterOperation::predefinedKernel("sharpen"));
+                                                                 return ReferenceFilters::applyOrderedDithering(result, 4, 4);
+                                                             },
+                                                             [regionPipeline](const QImage &image, const QRect &region)
+                                                             {
+                                                                 // applyRegion returns just the region.
+                                                                 return ImageProcessor::pasteRegion(image, region,
+                                                                                                    regionPipeline.applyRegion(image, region),
+                                                                                                    region.topLeft());
+                                                             }}}};
+    for (const QPair<QString, QPair<Filter, RegionFilter>> &entry : regionFilters)
+    {
+        const Filter reference = entry.second.first;
+        const RegionFilter filter = entry.second.second;
+        for (const RegionRect &regionRect : regionRects)
+        {
+            const auto rect = regionRect.rect;
+            cases.append({"region " + entry.first + " " + regionRect.name, [reference, rect](const QImage &image)
+                          { return reference(image).copy(rect(image.size())); },
+                          [filter, rect](const QImage &image)
+                          { return filter(image, rect(image.size())).copy(rect(image.size())); }});
+        }
+    }
+    return cases;
+}
+
+// Checks every case against the reference implementation, once per
+// convolution instruction set the CPU supports.
+static bool verify(const QVector<BenchmarkCase> &cases, const QImage &input)
+{
+    std::cout << "Verifying against the reference filters on " << input.width() << "x" << input.height() << std::endl;
+    QVector<QImage> expected;
+    for (const BenchmarkCase &benchmarkCase : cases)
+        expected.append(benchmarkCase.reference(input));
+
+    bool allMatch = true;
+    const ConvolutionKernels::InstructionSet detected = ConvolutionKernels::detectedInstructionSet();
+    for (int set = 0; set <= static_cast<int>(detected); ++set)
+    {
+        ConvolutionKernels::setInstructionSet(static_cast<ConvolutionKernels::InstructionSet>(set));
+        bool match = true;
+        for (int i = 0; i < cases.size(); ++i)
+        {
+            if (!samePixels(expected[i], cases[i].optimized(input)))
+            {
+                match = false;
+                std::cout << "  MISMATCH " << cases[i].name.toStdString() << std::endl;
+            }
+        }
+        allMatch = allMatch && match;
+        std::cout << "  instruction set " << ConvolutionKernels::instructionSetName(ConvolutionKernels::instructionSet()) << ": "
+                  << (match ? "identical" : "MISMATCH") << std::endl;
+    }
+    ConvolutionKernels::setInstructionSet(detected);
+    return allMatch;
+}
+
+// Times disc kernels of growing size directly and through FFT tiles, the
+// measurement FFT_CONVOLUTION_MIN_TAPS is taken from, and reports the
+// smallest kernel from which the FFT path stays faster.
+static void crossover(const QImage &input, int runs, QVector<BenchmarkResult> &results)
+{
+    std::cout << "FFT crossover on " << input.width() << "x" << input.height() << std::endl;
+    std::cout << std::left << std::setw(16) << "kernel" << std::right << std::setw(8) << "taps" << std::setw(12) << "direct ms"
+              << std::setw(12) << "FFT ms" << std::endl;
+
+    const int threshold = ImageProcessor::fftThreshold();
+    int crossoverTaps = -1;
+    for (int size = 5; size <= 63; size += 2)
+    {
+        const Kernel kernel = discKernel(size);
+        const Filter filter = [kernel](const QImage &image)
+        { return ImageProcessor::applyConvolution(image, kernel); };
+        QImage output;
+        ImageProcessor::setFftThreshold(std::numeric_limits<int>::max());
+        const QVector<double> direct = timeRuns(filter, input, output, runs);
+        ImageProcessor::setFftThreshold(0);
+        const QVector<double> fft = timeRuns(filter, input, output, runs);
+
+        const QString name = QString("disc %1x%2").arg(size).arg(size);
+        results.append({"direct " + name, input.width(), input.height(), runs, direct.first(), direct[direct.size() / 2]});
+        results.append({"fft " + name, input.width(), input.height(), runs, fft.first(), fft[fft.size() / 2]});
+        if (fft.first() >= direct.first())
+            crossoverTaps = -1;
+        else if (crossoverTaps < 0)
+            crossoverTaps = kernel.getTaps().size();
+
+        std::cout << std::left << std::setw(16) << name.toStdString() << std::right << std::setw(8) << kernel.getTaps().size()
+                  << std::fixed << std::setprecision(2) << std::setw(12) << direct.first() << std::setw(12) << fft.first() << std::endl;
+    }
+    ImageProcessor::setFftThreshold(threshold);
+
+    if (crossoverTaps < 0)
+        std::cout << "FFT tiles were not faster up to 63x63" << std::endl;
+    else
+        std::cout << "FFT tiles are faster from " << crossoverTaps << " taps (FFT_CONVOLUTION_MIN_TAPS is " << FFT_CONVOLUTION_MIN_TAPS
+                  << ")" << std::endl;
+}
+
+static QJsonObject toJson(const QVector<BenchmarkResult> &results)
+{
+    QJsonArray entries;
+    for (const BenchmarkResult &result : results)
+    {
+        entries.append(QJsonObject{{"filter", result.name},
+                                   {"width", result.width},
+                                   {"height", result.height},
+                                   {"megapixels", result.megapixels()},
+                                   {"runs", result.runs},
+                                   {"best_ms", result.bestMs},
+                                   {"median_ms", result.medianMs},
+                                   {"megapixels_per_second", result.megapixelsPerSecond()}});
+    }
+    return QJsonObject{{"timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+                       {"qt_version", qVersion()},
+                       {"ideal_thread_count", QThread::idealThreadCount()},
+                       {"threads", ImageProcessor::threadCount()},
+                       {"instruction_set", ConvolutionKernels::instructionSetName(ConvolutionKernels::instructionSet())},
+                       {"results", entries}};
+}
+
+static QString toCsv(const QVector<BenchmarkResult> &results)
+{
+    QString csv;
+    QTextStream out(&csv);
+    out << "filter,width,height,megapixels,threads,instruction_set,runs,best_ms,median_ms,megapixels_per_second\n";
+    for (const BenchmarkResult &result : results)
+    {
+        out << '"' << result.name << '"' << ',' << result.width << ',' << result.height << ',' << result.megapixels() << ','
+            << ImageProcessor::threadCount() << ',' << ConvolutionKernels::instructionSetName(ConvolutionKernels::instructionSet()) << ','
+            << result.runs << ',' << result.bestMs << ',' << result.medianMs << ',' << result.megapixelsPerSecond() << '\n';
+    }
+    return csv;
+}
+
+static bool writeFile(const QString &path, const QByteArray &contents)
+{
+    QFile file(path);
+    if (file.open(QIODevice::WriteOnly) && file.write(contents) == contents.size())
+        return true;
+    std::cerr << "filtering-benchmark: could not write " << path.toStdString() << std::endl;
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("filtering-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times every ImageProcessor filter on synthetic images and reports megapixels per second.");
+    parser.addHelpOption();
+    const QCommandLineOption sizesOption("sizes", "Comma-separated image sizes in megapixels.", "list", "0.25,1,4,12,50");
+    const QCommandLineOption runsOption("runs", "Timed runs per filter and size.", "count", "3");
+    const QCommandLineOption threadsOption("threads", "Filter threads, 0 for every core.", "count", "0");
+    const QCommandLineOption filterOption("filter", "Only run filters whose name contains this text.", "text");
+    const QCommandLineOption jsonOption("json", "Write the results as JSON to this file.", "file");
+    const QCommandLineOption csvOption("csv", "Write the results as CSV to this file.", "file");
+    const QCommandLineOption verifyOption("verify", "First compare every filter with the reference implementation on a WxH image.",
+                                          "WxH");
+    const QCommandLineOption crossoverOption("fft-crossover",
+                                             "Instead of the filters, time disc kernels directly and through FFT tiles at the first size.");
+    parser.addOptions({sizesOption, runsOption, threadsOption, filterOption, jsonOption, csvOption, verifyOption, crossoverOption});
+    parser.process(app);
+
+    bool runsOk = false;
+    bool threadsOk = false;
+    const int runs = parser.value(runsOption).toInt(&runsOk);
+    const int threads = parser.value(threadsOption).toInt(&threadsOk);
+    bool sizesOk = true;
+    QVector<double> sizes;
+    for (const QString &size : parser.value(sizesOption).split(',', Qt::SkipEmptyParts))
+    {
+        bool ok = false;
+        sizes.append(size.toDouble(&ok));
+        sizesOk = sizesOk && ok && sizes.last() > 0;
+    }
+    if (!runsOk || runs < 1 || !threadsOk || threads < 0 || !sizesOk || sizes.isEmpty())
+    {
+        std::cerr << "filtering-benchmark: invalid --sizes, --runs or --threads (see --help)" << std::endl;
+        return 2;
+    }
+    ImageProcessor::setThreadCount(threads);
+
+    QVector<BenchmarkCase> cases;
+    for (const BenchmarkCase &benchmarkCase : makeCases())
+    {
+        if (!parser.isSet(filterOption) || benchmarkCase.name.contains(parser.value(filterOption)))
+            cases.append(benchmarkCase);
+    }
+
+    bool allMatch = true;
+    if (parser.isSet(verifyOption))
+    {
+        const QStringList dimensions = parser.value(verifyOption).split('x');
+        const int width = dimensions.size() == 2 ? dimensions[0].toInt() : 0;
+        const int height = dimensions.size() == 2 ? dimensions[1].toInt() : 0;
+        if (width <= 0 || height <= 0)
+        {
+            std::cerr << "filtering-benchmark: --verify expects WxH, e.g. 640x480" << std::endl;
+            return 2;
+        }
+        allMatch = verify(cases, makeSyntheticImage(width, height));
+    }
+
+    std::cout << ImageProcessor::threadCount() << " thread(s), "
+              << ConvolutionKernels::instructionSetName(ConvolutionKernels::instructionSet()) << " convolution kernels" << std::endl;
+    QVector<BenchmarkResult> results;
+    if (parser.isSet(crossoverOption))
+    {
+        const QSize size = sizeForMegapixels(sizes.first());
+        crossover(makeSyntheticImage(size.width(), size.height()), runs, results);
+        sizes.clear();
+    }
+    else
+    {
+        std::cout << std::left << std::setw(34) << "filter" << std::right << std::setw(12) << "size" << std::setw(8) << "MP"
+                  << std::setw(12) << "best ms" << std::setw(12) << "median ms" << std::setw(10) << "MP/s" << std::endl;
+    }
+    for (double megapixels : sizes)
+    {
+        const QSize size = sizeForMegapixels(megapixels);
+        const QImage input = makeSyntheticImage(size.width(), size.height());
+        for (const BenchmarkCase &benchmarkCase : cases)
+        {
+            QImage output;
+            const QVector<double> times = timeRuns(benchmarkCase.optimized, input, output, runs);
+            const BenchmarkResult result = {benchmarkCase.name, size.width(), size.height(), runs, times.first(), times[times.size() / 2]};
+            results.append(result);
+
+            std::cout << std::left << std::setw(34) << result.name.toStdString() << std::right << std::setw(12)
+                      << QString("%1x%2").arg(result.width).arg(result.height).toStdString() << std::fixed << std::setprecision(2)
+                      << std::setw(8) << result.megapixels() << std::setw(12) << result.bestMs << std::setw(12) << result.medianMs
+                      << std::setw(10) << result.megapixelsPerSecond() << std::endl;
+        }
+    }
+
+    if (parser.isSet(jsonOption) && !writeFile(parser.value(jsonOption), QJsonDocument(toJson(results)).toJson()))
+        return 2;
+    if (parser.isSet(csvOption) && !writeFile(parser.value(csvOption), toCsv(results).toUtf8()))
+        return 2;
+
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+#ifndef REFERENCEFILTERS_H
+#define REFERENCEFILTERS_H
+
+#include <QImage>
+#include <QVector>
+#include "border.h"
+#include "kernel.h"
+
+// Original per-pixel QColor implementations of the ImageProcessor filters,
+// used by the benchmark to measure speedups and check that the optimized
+// filters produce identical pixels.
+class ReferenceFilters
+{
+public:
+    enum class Channel
+    {
+        H,
+        S,
+        V
+    };
+
+    static QImage invertColors(const QImage &image);
+    static QImage adjustBrightness(const QImage &image);
+    static QImage adjustContrast(const QImage &image);
+    static QImage gammaCorrection(const QImage &image);
+
+    // Every tap is mapped through border.map(), where ImageProcessor takes
+    // the kernel's own border.
+    static QImage applyConvolution(const QImage &image, const Kernel &kernel, const Border &border = Border());
+    static QImage applyMedianFilter(const QImage &image, int kernelSize, const Border &border = Border());
+
+    static QImage applyOrderedDithering(const QImage &image, int thresholdMapSize, int k);
+    static QImage applyUniformQuantization(const QImage &image, int rLevels, int gLevels, int bLevels);
+
+    static QImage applyGreyscaleFilter(const QImage &image);
+
+    static QImage convertToHSV(const QImage &image);
+    static QImage extractChannel(const QImage &hsvImage, Channel channel);
+    static QImage convertHSVToRGB(const QImage &hChannel, const QImage &sChannel, const QImage &vChannel);
+};
+
+#endif // REFERENCEFILTERS_H
@@ -0,0 +1,16 @@
+QT       += core gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = filtering-cli
+
+include(../processing.pri)
+
+SOURCES += \
+    main.cpp
+
+OBJECTS_DIR = obj
+MOC_DIR = obj
+RCC_DIR = obj
+UI_DIR = obj
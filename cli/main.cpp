@@ -0,0 +1,359 @@
+#include "filtercache.h"
+#include "filterconstants.h"
+#include "filteroperation.h"
+#include "filterpipeline.h"
+#include "imagebufferpool.h"
+#include "imageprocessor.h"
+#include "pixelaccess.h"
+#include "pnmstream.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadPool>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+struct BatchItem
+{
+    QString input;
+    QString output;
+};
+
+static QStringList imageNameFilters()
+{
+    QStringList filters;
+    for (const QByteArray &format : QImageReader::supportedImageFormats())
+        filters.append("*." + QString::fromLatin1(format));
+    return filters;
+}
+
+static QString outputPath(const QDir &outputDir, const QString &relativePath, const QString &format)
+{
+    QString path = outputDir.filePath(relativePath);
+    if (!format.isEmpty())
+    {
+        const QFileInfo info(path);
+        path = info.path() + "/" + info.completeBaseName() + "." + format;
+    }
+    return QDir::cleanPath(path);
+}
+
+// Expands files and directories into input/output pairs. Files found in a
+// directory keep their path relative to it under the output directory.
+static QVector<BatchItem> collectInputs(const QStringList &paths, const QDir &outputDir, const QString &format, bool recursive)
+{
+    QVector<BatchItem> items;
+    const QStringList nameFilters = imageNameFilters();
+    for (const QString &path : paths)
+    {
+        const QFileInfo info(path);
+        if (info.isDir())
+        {
+            const QDir inputDir(path);
+            QDirIterator it(path, nameFilters, QDir::Files, recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+            QStringList found;
+            while (it.hasNext())
+                found.append(it.next());
+            found.sort();
+            for (const QString &file : found)
+                items.append(BatchItem{file, outputPath(outputDir, inputDir.relativeFilePath(file), format)});
+        }
+        else if (info.isFile())
+        {
+            items.append(BatchItem{path, outputPath(outputDir, info.fileName(), format)});
+        }
+        else
+        {
+            throw std::runtime_error("No such file or directory: " + path.toStdString());
+        }
+    }
+    for (const BatchItem &item : items)
+    {
+        if (QFileInfo(item.input).absoluteFilePath() == QFileInfo(item.output).absoluteFilePath())
+            throw std::runtime_error("Refusing to overwrite input " + item.input.toStdString());
+    }
+    return items;
+}
+
+// Loads, filters and saves one image; returns false and sets error on
+// failure. Timings are in milliseconds.
+static bool processItem(const BatchItem &item, const QVector<FilterOperation> &chain, const FilterPipeline &pipeline, FilterCache *cache, QSize &size,
+                        double timings[3], QString &error)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QImage image;
+    if (!image.load(item.input))
+    {
+        error = "could not read image";
+        return false;
+    }
+    size = image.size();
+    timings[0] = timer.nsecsElapsed() / 1e6;
+
+    timer.restart();
+    try
+    {
+        // Without a cache nothing else needs the decoded image, so the
+        // chain can overwrite it.
+        image = cache ? cache->apply(chain, image) : pipeline.apply(std::move(image));
+    }
+    catch (const std::exception &e)
+    {
+        error = e.what();
+        return false;
+    }
+    timings[1] = timer.nsecsElapsed() / 1e6;
+
+    timer.restart();
+    if (!QDir().mkpath(QFileInfo(item.output).absolutePath()) || !image.save(item.output))
+    {
+        error = "could not write " + item.output;
+        return false;
+    }
+    timings[2] = timer.nsecsElapsed() / 1e6;
+    return true;
+}
+
+static bool isPnmFile(const QString &path)
+{
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "pgm" || suffix == "ppm" || suffix == "pnm";
+}
+
+// Like processItem(), but reads, filters and writes the image a strip of
+// about STREAM_STRIP_BYTES at a time, so it is never in memory as a whole.
+// PGM and PPM files are read directly; other formats only where their
+// reader can decode a clip rectangle, re-opening the file for every strip.
+// The output is written as PGM or PPM. Reading and writing are interleaved
+// with filtering, and their times are reported as load and save times.
+static bool streamItem(const BatchItem &item, const FilterPipeline &pipeline, QSize &size, double timings[3], QString &error)
+{
+    if (!isPnmFile(item.output))
+    {
+        error = "--stream writes only .pgm, .ppm or .pnm files (see --format)";
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 readNanoseconds = 0;
+    qint64 writeNanoseconds = 0;
+    try
+    {
+        std::unique_ptr<PnmReader> pnmReader;
+        FilterPipeline::StripReader read;
+        int nextRow = 0;
+        if (isPnmFile(item.input))
+        {
+            pnmReader.reset(new PnmReader(item.input));
+            size = pnmReader->size();
+            read = [&](int rowCount)
+            { return pnmReader->readRows(rowCount); };
+        }
+        else
+        {
+            QImageReader probe(item.input);
+            if (!probe.canRead() || !probe.supportsOption(QImageIOHandler::ClipRect) || !probe.size().isValid())
+            {
+                error = "image format cannot be read in strips";
+                return false;
+            }
+            size = probe.size();
+            read = [&](int rowCount)
+            {
+                QImageReader reader(item.input);
+                reader.setClipRect(QRect(0, nextRow, size.width(), rowCount));
+                const QImage rows = reader.read();
+                if (rows.isNull())
+                    throw std::runtime_error("could not read rows of " + item.input.toStdString());
+                nextRow += rowCount;
+                return rows.format() == QImage::Format_Grayscale8 ? rows : PixelAccess::normalized(rows);
+            };
+        }
+        readNanoseconds = timer.nsecsElapsed();
+
+        if (!QDir().mkpath(QFileInfo(item.output).absolutePath()))
+            throw std::runtime_error("could not write " + item.output.toStdString());
+        const QString outputSuffix = QFileInfo(item.output).suffix().toLower();
+        std::unique_ptr<PnmWriter> writer;
+        const int stripRows = qMax(qint64(1), STREAM_STRIP_BYTES / (qint64(size.width()) * 4));
+        QElapsedTimer ioTimer;
+        pipeline.applyStrips(
+            size.height(), stripRows,
+            [&](int rowCount)
+            {
+                ioTimer.start();
+                QImage rows = read(rowCount);
+                readNanoseconds += ioTimer.nsecsElapsed();
+                return rows;
+            },
+            [&](const QImage &rows, int firstRow, int rowCount)
+            {
+                ioTimer.start();
+                // A .pnm output gets whichever of the two the chain produces.
+                if (!writer)
+                    writer.reset(new PnmWriter(item.output, size,
+                                               outputSuffix == "pgm" || (outputSuffix == "pnm" && rows.format() == QImage::Format_Grayscale8)));
+                writer->writeRows(rows, firstRow, rowCount);
+                writeNanoseconds += ioTimer.nsecsElapsed();
+            });
+        if (!writer)
+            throw std::runtime_error("image has no pixels");
+        ioTimer.start();
+        writer->finish();
+        writeNanoseconds += ioTimer.nsecsElapsed();
+    }
+    catch (const std::exception &e)
+    {
+        error = e.what();
+        return false;
+    }
+    timings[0] = readNanoseconds / 1e6;
+    timings[1] = (timer.nsecsElapsed() - readNanoseconds - writeNanoseconds) / 1e6;
+    timings[2] = writeNanoseconds / 1e6;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("filtering-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Applies a filter chain to images without a display.\n\n"
+        "Filters (comma-separated, applied left to right):\n"
+        "  invert, brightness, contrast, gamma, greyscale\n"
+        "  blur, gaussian_blur, sharpen, edge_detection, emboss\n"
+        "  kernel:<file.flt>\n"
+        "  box:<size>\n"
+        "  median:<size>\n"
+        "  dither:<threshold map size>:<levels>\n"
+        "  quantize:<red levels>:<green levels>:<blue levels>\n"
+        "The predefined kernels, box and median take an optional border for\n"
+        "the pixels beyond the image edges: clamp (default), mirror, wrap or\n"
+        "constant:<0-255>, e.g. median:5:mirror or sharpen:constant:0.\n\n"
+        "Prints one tab-separated line per image: status, input, output, size,\n"
+        "load ms, filter ms, save ms (or the error).");
+    parser.addHelpOption();
+    parser.addPositionalArgument("inputs", "Image files or directories to process.", "inputs...");
+    const QCommandLineOption filtersOption({"f", "filters"}, "Filter chain to apply.", "chain");
+    const QCommandLineOption outputOption({"o", "output"}, "Directory the filtered images are written to.", "directory");
+    const QCommandLineOption formatOption("format", "Output file format, e.g. png (default: same as input).", "suffix");
+    const QCommandLineOption recursiveOption({"r", "recursive"}, "Descend into subdirectories of input directories.");
+    const QCommandLineOption jobsOption({"j", "jobs"}, "Images processed at the same time (default: one per core).", "count");
+    const QCommandLineOption threadsOption({"t", "threads"}, "Threads each image is split across (default: 1, or every core with -j 1).",
+                                           "count");
+    const QCommandLineOption cacheOption("cache-mb", "Reuse results for images with identical pixels, keeping up to this many MB of them.",
+                                         "megabytes");
+    const QCommandLineOption streamOption("stream", "Read, filter and write each image in strips to bound memory use; writes PGM/PPM only.");
+    parser.addOptions({filtersOption, outputOption, formatOption, recursiveOption, jobsOption, threadsOption, cacheOption, streamOption});
+    parser.process(app);
+
+    const QStringList inputs = parser.positionalArguments();
+    if (inputs.isEmpty() || !parser.isSet(filtersOption) || !parser.isSet(outputOption))
+    {
+        std::cerr << "filtering-cli: inputs, --filters and --output are required (see --help)" << std::endl;
+        return 2;
+    }
+
+    bool jobsOk = true;
+    bool threadsOk = true;
+    const int jobs = parser.isSet(jobsOption) ? parser.value(jobsOption).toInt(&jobsOk) : QThread::idealThreadCount();
+    const int threads = parser.isSet(threadsOption) ? parser.value(threadsOption).toInt(&threadsOk) : (jobs > 1 ? 1 : 0);
+    bool cacheOk = true;
+    const int cacheMegabytes = parser.isSet(cacheOption) ? parser.value(cacheOption).toInt(&cacheOk) : 0;
+    if (!jobsOk || !threadsOk || !cacheOk || jobs < 1 || threads < 0 || cacheMegabytes < 0)
+    {
+        std::cerr << "filtering-cli: --jobs must be at least 1, --threads and --cache-mb at least 0" << std::endl;
+        return 2;
+    }
+    if (parser.isSet(streamOption) && cacheMegabytes > 0)
+    {
+        std::cerr << "filtering-cli: --cache-mb needs whole images and cannot be combined with --stream" << std::endl;
+        return 2;
+    }
+
+    QVector<FilterOperation> chain;
+    QVector<BatchItem> items;
+    try
+    {
+        chain = FilterOperation::parseChain(parser.value(filtersOption));
+        items = collectInputs(inputs, QDir(parser.value(outputOption)), parser.value(formatOption), parser.isSet(recursiveOption));
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "filtering-cli: " << e.what() << std::endl;
+        return 2;
+    }
+
+    if (parser.isSet(streamOption) && !FilterPipeline(chain).isLocal())
+    {
+        std::cerr << "filtering-cli: mirror and wrap borders need whole images and cannot be combined with --stream" << std::endl;
+        return 2;
+    }
+
+    ImageProcessor::setThreadCount(threads);
+    std::cerr << "Processing " << items.size() << " image(s) with " << FilterOperation::chainToString(chain).toStdString() << ", "
+              << jobs << " job(s) x " << ImageProcessor::threadCount() << " thread(s)" << std::endl;
+
+    std::cout << std::fixed << std::setprecision(2);
+    QElapsedTimer total;
+    total.start();
+    const FilterPipeline pipeline(chain);
+    FilterCache cache(cacheMegabytes * 1024LL * 1024);
+    FilterCache *resultCache = cacheMegabytes > 0 ? &cache : nullptr;
+    const bool stream = parser.isSet(streamOption);
+    std::atomic<int> nextItem{0};
+    std::atomic<int> failures{0};
+    QMutex outputMutex;
+    QThreadPool pool;
+    pool.setMaxThreadCount(jobs);
+    for (int job = 0; job < jobs; ++job)
+    {
+        pool.start([&]()
+                   {
+            for (int i = nextItem++; i < items.size(); i = nextItem++)
+            {
+                QSize size;
+                double timings[3] = {0, 0, 0};
+                QString error;
+                const bool ok = stream ? streamItem(items[i], pipeline, size, timings, error)
+                                       : processItem(items[i], chain, pipeline, resultCache, size, timings, error);
+                if (!ok)
+                    ++failures;
+
+                QMutexLocker locker(&outputMutex);
+                std::cout << (ok ? "ok" : "error") << '\t' << items[i].input.toStdString() << '\t' << items[i].output.toStdString();
+                if (ok)
+                    std::cout << '\t' << size.width() << 'x' << size.height() << '\t' << timings[0] << '\t' << timings[1] << '\t' << timings[2];
+                else
+                    std::cout << '\t' << error.toStdString();
+                std::cout << std::endl;
+            } });
+    }
+    pool.waitForDone();
+
+    std::cerr << "Done in " << total.elapsed() / 1000.0 << " s, " << items.size() - failures << " written, " << failures << " failed"
+              << std::endl;
+    if (resultCache)
+    {
+        const FilterCache::Statistics statistics = resultCache->statistics();
+        std::cerr << "Cache: " << statistics.hits << " hit(s), " << statistics.misses << " miss(es)" << std::endl;
+    }
+    const ImageBufferPool::Statistics buffers = ImageBufferPool::statistics();
+    std::cerr << "Buffers: " << qRound(buffers.reuseRate() * 100) << "% of " << buffers.requests << " reused, peak "
+              << buffers.peakBytes / (1024 * 1024) << " MB" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -8,17 +8,15 @@ CONFIG += c++17
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(processing.pri)
+
 SOURCES += \
     main.cpp \
-    src/kernel.cpp \
-    src/imageprocessor.cpp \
     src/filtereditordialog.cpp \
     src/mainwindow.cpp
 
 
 HEADERS += \
-    include/kernel.h \
-    include/imageprocessor.h \
     include/filtereditordialog.h \
     include/mainwindow.h
 
@@ -30,8 +28,6 @@ MOC_DIR = obj
 RCC_DIR = obj
 UI_DIR = obj
 
-INCLUDEPATH += include
-
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
@@ -0,0 +1,59 @@
+#ifndef BORDER_H
+#define BORDER_H
+
+#include <QString>
+
+// What the neighborhood filters (convolution and median) read beyond the
+// edges of the image:
+//
+//   clamp        the nearest edge pixel (the default)
+//   mirror       the image reflected about its edge pixels, which are not
+//                repeated: ... 2 1 | 0 1 2 ... w-1 | w-2 w-3 ...
+//   wrap         the image repeated, as if it were tiled
+//   constant:<v> a grey level v in [0, 255]
+//
+// The text forms are those of parse() and name(), used in .flt files and
+// filter specs.
+class Border
+{
+public:
+    enum class Mode
+    {
+        Clamp,
+        Mirror,
+        Wrap,
+        Constant
+    };
+
+    Border();
+    // value is the grey level of a Constant border and must be 0 for the
+    // other modes.
+    explicit Border(Mode mode, int value = 0);
+
+    Mode mode() const;
+    int value() const;
+
+    // The index in [0, size) that index i of a row or column of size
+    // pixels reads, or -1 where a Constant border supplies value() instead.
+    int map(int i, int size) const;
+
+    // Clamp and Constant borders depend on no pixel further than the edge
+    // itself, so a filter run on part of an image reproduces the whole
+    // image's result away from the cut. Mirror and Wrap borders read pixels
+    // deeper inside the image, so strip and region filtering run those on
+    // the whole image.
+    bool isLocal() const;
+
+    // Throws std::runtime_error for anything but the forms above.
+    static Border parse(const QString &text);
+    QString name() const;
+
+    bool operator==(const Border &other) const;
+    bool operator!=(const Border &other) const;
+
+private:
+    Mode borderMode;
+    int constantValue;
+};
+
+#endif // BORDER_H
@@ -0,0 +1,54 @@
+#ifndef CONVOLUTIONKERNELS_H
+#define CONVOLUTIONKERNELS_H
+
+#include <QImage>
+
+// Row primitives of the convolution engine. Each one processes a run of
+// output pixels held as separate 32-bit red, green and blue accumulators.
+// SSE4.1 and AVX2 versions are picked at runtime from the CPU features,
+// with a portable scalar fallback; all of them produce identical results.
+class ConvolutionKernels
+{
+public:
+    enum class InstructionSet
+    {
+        Scalar,
+        SSE41,
+        AVX2
+    };
+
+    // acc[i] += weight * values[i] for i in [0, count)
+    static void multiplyAccumulate(int *acc, const uchar *values, int weight, int count);
+    static void multiplyAccumulate(int *acc, const int *values, int weight, int count);
+
+    // dst[i] = qRgb of each channel clamped to [0, 255] after
+    // static_cast<int>(factor * sum + bias), the rounding applyConvolution
+    // has always used.
+    static void storePixels(QRgb *dst, const int *red, const int *green, const int *blue, double factor, int bias, int count);
+    // The same rounding for a single channel plane.
+    static void storeChannel(uchar *dst, const int *sums, double factor, int bias, int count);
+
+    // One output row of a 3x3 or 5x5 kernel with all the taps of a pixel
+    // kept in registers: sums[i] = the sum over r and c of
+    // coefficients[r * size + c] * rows[r][i + c] for i in [0, count),
+    // where multiplyAccumulate makes one pass over the sums per tap. The
+    // loops over the taps are unrolled at compile time, and the predefined
+    // kernels of filterconstants.h have their coefficients compiled in, so
+    // zero taps vanish and the others become additions, subtractions and
+    // shifts where they can.
+    using WindowFunction = void (*)(int *sums, const uchar *const *rows, const int *coefficients, int count);
+    // The window function of the selected instruction set for a size x size
+    // kernel with these row-major coefficients, nullptr unless size is 3
+    // or 5. The coefficients are still passed to every call.
+    static WindowFunction windowFunction(int size, const int *coefficients);
+
+    static InstructionSet detectedInstructionSet();
+    static InstructionSet instructionSet();
+    // Selects a specific implementation, e.g. to validate one against the
+    // scalar path. Requests beyond what the CPU supports fall back to the
+    // detected set.
+    static void setInstructionSet(InstructionSet set);
+    static const char *instructionSetName(InstructionSet set);
+};
+
+#endif // CONVOLUTIONKERNELS_H
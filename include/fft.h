@@ -0,0 +1,47 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <QVector>
+#include <complex>
+
+// Radix-2 fast Fourier transform of power-of-two sizes, in place, for the
+// FFT convolution path. An Fft holds the bit-reversal permutation and the
+// twiddle factors of one size, so the many rows and columns of a tile reuse
+// them.
+class Fft
+{
+public:
+    using Complex = std::complex<double>;
+
+    // size must be a power of two.
+    explicit Fft(int size);
+    int size() const;
+
+    // Transforms data[0, size()) in place. inverse() does not divide by
+    // size(); callers fold that into their own scaling.
+    void forward(Complex *data) const;
+    void inverse(Complex *data) const;
+
+    // Transform a row-major grid of columns.size() rows and rows.size()
+    // columns in place: every row with the rows plan, then every column
+    // with the columns plan.
+    static void forward2D(Complex *data, const Fft &rows, const Fft &columns);
+    static void inverse2D(Complex *data, const Fft &rows, const Fft &columns);
+
+    // data[i] *= factors[i] for i in [0, count).
+    static void multiply(Complex *data, const Complex *factors, int count);
+
+    // Smallest power of two not below n.
+    static int nextPowerOfTwo(int n);
+
+private:
+    void transform(Complex *data, bool inverse) const;
+    static void transform2D(Complex *data, const Fft &rows, const Fft &columns, bool inverse);
+
+    int length;
+    QVector<int> reversed;
+    QVector<Complex> twiddles;
+    QVector<Complex> inverseTwiddles;
+};
+
+#endif // FFT_H
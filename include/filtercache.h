@@ -0,0 +1,66 @@
+#ifndef FILTERCACHE_H
+#define FILTERCACHE_H
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QVector>
+#include <functional>
+#include "filteroperation.h"
+
+// Memoizes filter results by the content of the input image and the
+// operation with all its parameters (FilterOperation::key()), so applying a
+// filter again to the same image, like switching back and forth between two
+// median sizes, costs a lookup. Results are evicted least recently used once
+// they exceed the memory budget. Safe to share between threads; a filter is
+// computed outside the lock, so two threads missing the same entry both
+// compute it.
+class FilterCache
+{
+public:
+    struct Statistics
+    {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        int entries = 0;
+        qint64 bytes = 0;
+    };
+
+    explicit FilterCache(qint64 memoryBudget);
+
+    QImage apply(const FilterOperation &operation, const QImage &image);
+    // The whole chain as one entry, computed with a FilterPipeline.
+    QImage apply(const QVector<FilterOperation> &chain, const QImage &image);
+
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const;
+    Statistics statistics() const;
+    void clear();
+
+    // Hash of the size, format and pixels of image.
+    static quint64 fingerprint(const QImage &image);
+
+private:
+    struct Entry
+    {
+        QImage image;
+        quint64 lastUse;
+    };
+
+    QImage lookup(const QString &operationKey, const QImage &image, const std::function<QImage()> &compute);
+    quint64 imageFingerprint(const QImage &image);
+    void evict();
+
+    mutable QMutex mutex;
+    qint64 budget;
+    QHash<QString, Entry> entries;
+    qint64 entryBytes = 0;
+    quint64 useCounter = 0;
+    quint64 hits = 0;
+    quint64 misses = 0;
+    // Fingerprints by QImage::cacheKey(), which changes whenever an image is
+    // modified, so an image that is filtered repeatedly is hashed once.
+    QHash<qint64, quint64> fingerprints;
+};
+
+#endif // FILTERCACHE_H
@@ -17,46 +17,71 @@ const double CONTRAST_ADJUSTMENT = 20;
 const double GAMMA_CORRECTION = 1.5;
 
 // Convolution Kernels
+// Compile-time tables of the predefined kernels. The 3x3 and 5x5 window
+// functions of ConvolutionKernels compile these coefficients in; the
+// get...Kernel() functions build the same tables for Kernel.
+constexpr int BLUR_KERNEL[3][3] = {
+    {1, 1, 1},
+    {1, 1, 1},
+    {1, 1, 1}};
+
+constexpr int GAUSSIAN_BLUR_KERNEL[5][5] = {
+    {0, 1, 2, 1, 0},
+    {1, 4, 8, 4, 1},
+    {2, 8, 16, 8, 2},
+    {1, 4, 8, 4, 1},
+    {0, 1, 2, 1, 0}};
+
+constexpr int SHARPEN_KERNEL[3][3] = {
+    {0, -1, 0},
+    {-1, 5, -1},
+    {0, -1, 0}};
+
+constexpr int EDGE_DETECTION_KERNEL[3][3] = {
+    {-1, -1, -1},
+    {-1, 8, -1},
+    {-1, -1, -1}};
+
+constexpr int EMBOSS_KERNEL[3][3] = {
+    {-2, -1, 0},
+    {-1, 1, 1},
+    {0, 1, 2}};
+
+template <int Rows, int Cols>
+inline QVector<QVector<int>> kernelTable(const int (&coefficients)[Rows][Cols])
+{
+    QVector<QVector<int>> table(Rows, QVector<int>(Cols));
+    for (int r = 0; r < Rows; ++r)
+    {
+        for (int c = 0; c < Cols; ++c)
+            table[r][c] = coefficients[r][c];
+    }
+    return table;
+}
+
 inline QVector<QVector<int>> getBlurKernel()
 {
-    return {
-        {1, 1, 1},
-        {1, 1, 1},
-        {1, 1, 1}};
+    return kernelTable(BLUR_KERNEL);
 }
 
 inline QVector<QVector<int>> getGaussianBlurKernel()
 {
-    return {
-        {0, 1, 2, 1, 0},
-        {1, 4, 8, 4, 1},
-        {2, 8, 16, 8, 2},
-        {1, 4, 8, 4, 1},
-        {0, 1, 2, 1, 0}};
+    return kernelTable(GAUSSIAN_BLUR_KERNEL);
 }
 
 inline QVector<QVector<int>> getSharpenKernel()
 {
-    return {
-        {0, -1, 0},
-        {-1, 5, -1},
-        {0, -1, 0}};
+    return kernelTable(SHARPEN_KERNEL);
 }
 
 inline QVector<QVector<int>> getEdgeDetectionKernel()
 {
-    return {
-        {-1, -1, -1},
-        {-1, 8, -1},
-        {-1, -1, -1}};
+    return kernelTable(EDGE_DETECTION_KERNEL);
 }
 
 inline QVector<QVector<int>> getEmbossKernel()
 {
-    return {
-        {-2, -1, 0},
-        {-1, 1, 1},
-        {0, 1, 2}};
+    return kernelTable(EMBOSS_KERNEL);
 }
 
 inline QVector<QVector<int>> getOrderedDitheringKernel(int n) {
@@ -120,4 +145,36 @@ const int EMBOSS_ANCHOR_Y = 1;
 
 const int DITHERING_QUANTIZATION_LEVEL = 4;
 
+// Undo History
+// Bytes of full-resolution results kept for undo and redo besides the
+// original image.
+const qint64 HISTORY_CACHE_LIMIT = 512LL * 1024 * 1024;
+
+// Result Cache
+// Bytes of filter results the application keeps to answer repeated filters.
+const qint64 FILTER_CACHE_LIMIT = 256LL * 1024 * 1024;
+
+// Buffer Pool
+// Bytes of released image and scratch buffers kept for reuse by the filters.
+const qint64 BUFFER_POOL_LIMIT = 256LL * 1024 * 1024;
+
+// Filter Editor
+// Largest number of rows or columns of a kernel in the custom filter
+// editor. Dense kernels of that size are convolved through FFT tiles (see
+// FFT_CONVOLUTION_MIN_TAPS).
+const int KERNEL_EDITOR_MAX_SIZE = 63;
+
+// FFT Convolution
+// Non-zero coefficients from which a kernel that is neither box nor
+// separable is convolved through FFT tiles instead of directly; the
+// crossover measured by `filtering-benchmark --fft-crossover`.
+const int FFT_CONVOLUTION_MIN_TAPS = 300;
+// Largest transform size of an FFT tile in either direction; kernels over
+// half of it in either direction are always convolved directly.
+const int FFT_CONVOLUTION_MAX_SIZE = 1024;
+
+// Streaming
+// Bytes of image rows the command-line tool reads at a time with --stream.
+const qint64 STREAM_STRIP_BYTES = 16LL * 1024 * 1024;
+
 #endif // FILTERCONSTANTS_H
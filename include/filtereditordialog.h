@@ -4,6 +4,7 @@
 #include <QDialog>
 #include <QTableWidget>
 #include <QSpinBox>
+#include <QComboBox>
 #include <QLineEdit>
 #include <QPushButton>
 #include "kernel.h"
@@ -29,6 +30,7 @@ private slots:
     void saveAsCustomFilter();
     void loadCustomFilter();
     void applyFilter();
+    void updateBorderValue();
 
 private:
     QTableWidget *kernelTable;
@@ -38,7 +40,12 @@ private:
     QLineEdit *offsetEdit;
     QSpinBox *anchorRowSpinBox;
     QSpinBox *anchorColSpinBox;
+    QComboBox *borderComboBox;
+    QSpinBox *borderValueSpinBox;
     QString filterPath;
+
+    // The border selected in the combo box.
+    Border border() const;
 };
 
 #endif // FILTEREDITORDIALOG_H
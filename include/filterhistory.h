@@ -0,0 +1,60 @@
+#ifndef FILTERHISTORY_H
+#define FILTERHISTORY_H
+
+#include <QHash>
+#include <QImage>
+#include <QVector>
+#include "filteroperation.h"
+
+// Undo/redo history of the filters applied to one image. State 0 is the
+// original and state i the result of the first i operations; undo and redo
+// move the current position between states, and applying a filter drops
+// the states after it. Results are kept in a least recently used cache
+// bounded by cacheLimit bytes (the original is always kept), and a state
+// that was never stored or has been evicted is rebuilt by replaying the
+// operations from the nearest cached state before it.
+class FilterHistory
+{
+public:
+    explicit FilterHistory(qint64 cacheLimit);
+
+    void reset(const QImage &original);
+    void push(const FilterOperation &operation);
+    bool canUndo() const;
+    bool canRedo() const;
+    void undo();
+    void redo();
+
+    int position() const;
+    // Operations leading from state from to state to (from <= to).
+    QVector<FilterOperation> operations(int from, int to) const;
+
+    void store(int state, const QImage &image);
+    // The closest state at or before state whose image is cached.
+    int nearestCached(int state) const;
+    // Image of a cached state.
+    QImage cached(int state);
+    // Image of any state, replaying operations when it is not cached.
+    QImage imageAt(int state);
+
+    qint64 cacheSize() const;
+
+private:
+    struct Snapshot
+    {
+        QImage image;
+        quint64 lastUse;
+    };
+
+    void evict(int keepState);
+
+    const qint64 cacheLimit;
+    QImage original;
+    QVector<FilterOperation> chain;
+    int current = 0;
+    QHash<int, Snapshot> snapshots;
+    qint64 snapshotBytes = 0;
+    quint64 useCounter = 0;
+};
+
+#endif // FILTERHISTORY_H
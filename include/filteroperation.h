@@ -0,0 +1,116 @@
+#ifndef FILTEROPERATION_H
+#define FILTEROPERATION_H
+
+#include <QImage>
+#include <QMargins>
+#include <QRect>
+#include <QString>
+#include <QVector>
+#include "border.h"
+#include "kernel.h"
+#include "lookuptable.h"
+
+// One step of a filter chain: an ImageProcessor filter together with its
+// parameters. Operations have a textual form so chains can be given on a
+// command line or stored, e.g. "brightness,median:5,kernel:my/edges.flt":
+//
+//   invert, brightness, contrast, gamma, greyscale
+//   blur, gaussian_blur, sharpen, edge_detection, emboss   (assets/filters)
+//   kernel:<path to .flt file>
+//   box:<size>                                             (size x size mean)
+//   median:<size>
+//   dither:<threshold map size>:<levels>
+//   quantize:<red levels>:<green levels>:<blue levels>
+//
+// The predefined kernels, box and median take an optional border after
+// their parameters, e.g. "sharpen:mirror", "box:9:wrap" or
+// "median:5:constant:0" (see Border); a .flt file names its own.
+class FilterOperation
+{
+public:
+    enum class Type
+    {
+        Invert,
+        Brightness,
+        Contrast,
+        Gamma,
+        Greyscale,
+        Convolution,
+        Median,
+        OrderedDithering,
+        UniformQuantization
+    };
+
+    FilterOperation();
+
+    static FilterOperation invert();
+    static FilterOperation brightness();
+    static FilterOperation contrast();
+    static FilterOperation gamma();
+    static FilterOperation greyscale();
+    // name is the predefined filter name, "kernel:<path>" or "box:<size>",
+    // used by toString().
+    static FilterOperation convolution(const Kernel &kernel, const QString &name);
+    static FilterOperation median(int kernelSize, const Border &border = Border());
+    static FilterOperation orderedDithering(int thresholdMapSize, int levels);
+    static FilterOperation uniformQuantization(int rLevels, int gLevels, int bLevels);
+
+    // Loads one of the kernels shipped in PREDEFINED_FILTERS_DIR by its file
+    // name without extension, falling back to the built-in coefficients when
+    // the file is missing.
+    static Kernel predefinedKernel(const QString &name);
+
+    // Both throw std::runtime_error describing the offending spec.
+    static FilterOperation parse(const QString &spec);
+    static QVector<FilterOperation> parseChain(const QString &chain);
+
+    Type type() const;
+    QString toString() const;
+    // Like toString(), but naming every parameter the result depends on (for
+    // a convolution the kernel itself rather than its name), so operations
+    // with equal keys produce equal images.
+    QString key() const;
+    QImage apply(const QImage &image) const;
+    // Overwrites image where ImageProcessor has an in-place variant.
+    QImage apply(QImage &&image) const;
+    // Filters only region, as the ImageProcessor region variants do.
+    QImage apply(const QImage &image, const QRect &region) const;
+
+    // Invert, brightness, contrast, gamma and uniform quantization map each
+    // channel on its own; lookupTable() is their table.
+    bool isPointOperation() const;
+    LookupTable lookupTable() const;
+    // The kernel of a Convolution operation.
+    const Kernel &convolutionKernel() const;
+    // What a convolution or median reads beyond the image edges; clamp for
+    // the other operations.
+    Border border() const;
+
+    // Pixels left of, above, right of and below an output pixel the
+    // operation reads; none for the operations that map each pixel on its
+    // own.
+    QMargins margins() const;
+    // Pixels after which the result's dependence on the pixel position
+    // repeats, across and down: the threshold map size for ordered
+    // dithering, 1 for the others.
+    int period() const;
+
+    // The operation to run on a copy of the image scaled by factor (< 1) so
+    // it looks like the full-size result scaled down: kernel and median
+    // windows shrink with the image but never below 3x3 or their own size.
+    FilterOperation scaled(double factor) const;
+
+    static QImage applyChain(const QImage &image, const QVector<FilterOperation> &chain);
+    static QString chainToString(const QVector<FilterOperation> &chain);
+
+private:
+    FilterOperation(Type type, const QVector<int> &parameters);
+
+    Type operationType;
+    QVector<int> parameters;
+    Border medianBorder;
+    Kernel kernel;
+    QString kernelName;
+};
+
+#endif // FILTEROPERATION_H
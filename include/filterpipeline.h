@@ -0,0 +1,92 @@
+#ifndef FILTERPIPELINE_H
+#define FILTERPIPELINE_H
+
+#include <QImage>
+#include <QMargins>
+#include <QRect>
+#include <QVector>
+#include "filteroperation.h"
+#include "pixelaccess.h"
+#include <functional>
+
+// A filter chain compiled for a single run over the image. Consecutive point
+// operations are merged into one lookup table, and runs of convolutions
+// (with the point operations between them) are streamed strip by strip
+// through every stage, so their intermediate rows stay in cache instead of
+// becoming whole images. Median, dithering, greyscale and convolutions with
+// mirror or wrap borders split the chain and run as usual. The result is
+// identical to FilterOperation::applyChain.
+class FilterPipeline
+{
+public:
+    FilterPipeline();
+    explicit FilterPipeline(const QVector<FilterOperation> &operations);
+
+    void append(const FilterOperation &operation);
+    const QVector<FilterOperation> &operations() const;
+    bool isEmpty() const;
+
+    // Passes over the image apply() makes at most, one per compiled stage;
+    // the number of passes a TileScheduler::Task watching it should expect.
+    int passCount() const;
+
+    QImage apply(const QImage &image) const;
+    // Runs the chain in place on image when nothing else shares it; every
+    // stage after the first does so anyway, on the intermediate result.
+    QImage apply(QImage &&image) const;
+
+    // Returns the next rowCount rows of the image being streamed.
+    using StripReader = std::function<QImage(int rowCount)>;
+    // Receives rowCount finished rows starting at row firstRow of rows.
+    using StripWriter = std::function<void(const QImage &rows, int firstRow, int rowCount)>;
+
+    // Pixels around an output pixel the whole chain reads, and the period
+    // of its position-dependent stages (see FilterOperation).
+    QMargins margins() const;
+    int period() const;
+    // Whether margins() bounds what the chain reads, i.e. every border in it
+    // is local (Border::isLocal()). Otherwise the region variants filter the
+    // whole image and applyStrips() throws.
+    bool isLocal() const;
+
+    // The pixels of region (clipped to the image) of apply(image), computed
+    // from only the part of image they depend on.
+    QImage applyRegion(const QImage &image, const QRect &region) const;
+    // image with only region filtered; see the ImageProcessor region
+    // variants.
+    QImage apply(const QImage &image, const QRect &region) const;
+
+    // Filters an image of the given height that is never held in memory as
+    // a whole: it is read from top to bottom and written stripRows rows at a
+    // time. Each strip is filtered together with the rows around it the
+    // chain reads, kept from the previous strip where possible, so the
+    // written rows equal those apply() produces for the whole image. Throws
+    // std::runtime_error unless isLocal().
+    void applyStrips(int height, int stripRows, const StripReader &read, const StripWriter &write) const;
+
+private:
+    struct Stage
+    {
+        enum class Kind
+        {
+            Lookup,    // table over the whole image
+            Streamed,  // table, then each kernel followed by its table
+            Operation  // operation on its own
+        };
+
+        Kind kind;
+        LookupTable table;
+        QVector<Kernel> kernels;
+        QVector<LookupTable> kernelTables;
+        FilterOperation operation;
+    };
+
+    static QImage applyStreamed(QImage &&image, const Stage &stage);
+    static void streamRows(const Stage &stage, const PixelAccess::ConstRowFunction &sourceRow, const PixelAccess::RowFunction &resultRow,
+                           int width, int height, int firstRow, int lastRow);
+
+    QVector<FilterOperation> chain;
+    QVector<Stage> stages;
+};
+
+#endif // FILTERPIPELINE_H
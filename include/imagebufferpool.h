@@ -0,0 +1,111 @@
+#ifndef IMAGEBUFFERPOOL_H
+#define IMAGEBUFFERPOOL_H
+
+#include <QImage>
+#include <QSize>
+#include <type_traits>
+#include <utility>
+
+// Process-wide pool of the memory the filters work in: result images,
+// PlanarImage planes and per-band scratch rows. Buffers handed out go back
+// to the pool when released (for images: when the last QImage sharing the
+// buffer is destroyed) and are handed out again for requests of about the
+// same size, so a batch of same-sized images or a filter chain reuses a few
+// buffers instead of allocating and page-faulting new ones for every pass.
+// Idle buffers beyond limit() are freed, least recently released first.
+// Safe to use from any thread.
+class ImageBufferPool
+{
+public:
+    static const int ALIGNMENT = 64;
+
+    struct Statistics
+    {
+        quint64 requests = 0;
+        // Requests served with an idle buffer.
+        quint64 reused = 0;
+        qint64 bytesInUse = 0;
+        qint64 idleBytes = 0;
+        // Highest bytesInUse + idleBytes so far.
+        qint64 peakBytes = 0;
+
+        double reuseRate() const
+        {
+            return requests ? double(reused) / requests : 0.0;
+        }
+    };
+
+    // ALIGNMENT-aligned memory of at least the requested size.
+    struct Block
+    {
+        uchar *data = nullptr;
+        qsizetype capacity = 0;
+    };
+
+    static Block acquire(qsizetype bytes);
+    static void release(const Block &block);
+
+    // An uninitialized image backed by a pooled buffer. Formats other than
+    // the 8- and 32-bit ones the filters produce get a plain QImage.
+    static QImage createImage(const QSize &size, QImage::Format format);
+
+    // Scratch array of count trivially copyable values, uninitialized,
+    // returned to the pool when it goes out of scope.
+    template <typename T>
+    class Scratch
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Scratch holds raw memory");
+
+    public:
+        explicit Scratch(qsizetype count = 0)
+        {
+            resize(count);
+        }
+        Scratch(Scratch &&other) noexcept
+            : block(std::exchange(other.block, Block())), count(std::exchange(other.count, 0))
+        {
+        }
+        Scratch(const Scratch &) = delete;
+        Scratch &operator=(const Scratch &) = delete;
+        ~Scratch()
+        {
+            if (block.data)
+                ImageBufferPool::release(block);
+        }
+
+        // Contents are not kept when the buffer has to grow.
+        void resize(qsizetype newCount)
+        {
+            const qsizetype bytes = newCount * qsizetype(sizeof(T));
+            if (bytes > block.capacity)
+            {
+                if (block.data)
+                    ImageBufferPool::release(block);
+                block = ImageBufferPool::acquire(bytes);
+            }
+            count = newCount;
+        }
+
+        T *data() { return reinterpret_cast<T *>(block.data); }
+        const T *constData() const { return reinterpret_cast<const T *>(block.data); }
+        T &operator[](qsizetype i) { return data()[i]; }
+        const T &operator[](qsizetype i) const { return constData()[i]; }
+        qsizetype size() const { return count; }
+
+    private:
+        Block block;
+        qsizetype count = 0;
+    };
+
+    // Bytes of idle buffers kept for reuse (default BUFFER_POOL_LIMIT); 0
+    // frees every buffer as soon as it is released.
+    static void setLimit(qint64 bytes);
+    static qint64 limit();
+
+    static Statistics statistics();
+    static void resetStatistics();
+    // Frees all idle buffers.
+    static void clear();
+};
+
+#endif // IMAGEBUFFERPOOL_H
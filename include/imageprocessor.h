@@ -2,8 +2,15 @@
 #define IMAGEPROCESSOR_H
 
 #include <QImage>
+#include <QMargins>
+#include <QRect>
 #include <QVector>
+#include <functional>
+#include "border.h"
 #include "kernel.h"
+#include "lookuptable.h"
+#include "pixelaccess.h"
+#include "planarimage.h"
 
 class ImageProcessor
 {
@@ -15,22 +22,125 @@ public:
         V
     };
 
+    // Number of threads the filters split their rows across; 0 uses every
+    // available core.
+    static void setThreadCount(int count);
+    static int threadCount();
+
     static QImage invertColors(const QImage &image);
     static QImage adjustBrightness(const QImage &image);
     static QImage adjustContrast(const QImage &image);
     static QImage gammaCorrection(const QImage &image);
 
+    // Point operations as lookup tables, so callers can compose several of
+    // them with LookupTable::then() and apply the chain in one pass.
+    static LookupTable invertTable();
+    static LookupTable brightnessTable();
+    static LookupTable contrastTable();
+    static LookupTable gammaTable();
+    static LookupTable uniformQuantizationTable(int rLevels, int gLevels, int bLevels);
+    static QImage applyLookupTable(const QImage &image, const LookupTable &table);
+
+    // Any rows x cols kernel is supported; 1xN and Nx1 kernels run as a single
+    // pass of N taps per channel, 3x3 and 5x5 ones through the unrolled
+    // window functions of ConvolutionKernels. Large kernels that are neither
+    // box nor separable are convolved through FFT tiles, with the same
+    // result. What lies beyond the image edges is the kernel's getBorder().
     static QImage applyConvolution(const QImage &image, const Kernel &kernel);
-    static QImage applyMedianFilter(const QImage &image, int kernelSize);
+
+    // Non-zero coefficients from which such a kernel takes the FFT path
+    // (default FFT_CONVOLUTION_MIN_TAPS). Benchmarks and tests compare the
+    // two paths with 0, FFT wherever a band is at least as tall as the
+    // kernel, and INT_MAX, always direct.
+    static void setFftThreshold(int taps);
+    static int fftThreshold();
+
+    // Rows of a WorkingFormat image, by row index.
+    using ConstRowFunction = PixelAccess::ConstRowFunction;
+    using RowFunction = PixelAccess::RowFunction;
+
+    // Convolves rows [firstRow, lastRow) of a width x height image whose
+    // rows are read through sourceRow (only for y in [0, height)) into the
+    // rows returned by resultRow. applyConvolution runs it once per band;
+    // FilterPipeline chains several of them over small row buffers.
+    static void convolveRows(const ConstRowFunction &sourceRow, const RowFunction &resultRow, int width, int height, const Kernel &kernel,
+                             int firstRow, int lastRow);
+    // border is what the kernelSize x kernelSize window reads beyond the
+    // image edges.
+    static QImage applyMedianFilter(const QImage &image, int kernelSize, const Border &border = Border());
 
     static QImage applyOrderedDithering(const QImage &image, int thresholdMapSize, int k);
     static QImage applyUniformQuantization(const QImage &image, int rLevels, int gLevels, int bLevels);
 
     static QImage applyGreyscaleFilter(const QImage &image);
 
+    // H, S and V as Grayscale8 planes.
+    struct HSVPlanes
+    {
+        QImage h;
+        QImage s;
+        QImage v;
+    };
+
     static QImage convertToHSV(const QImage &image);
+    // The planes extractChannel() would take from convertToHSV(image), made
+    // in a single pass without the packed HSV image. They are views of one
+    // PlanarImage.
+    static HSVPlanes splitHSV(const QImage &image);
     static QImage extractChannel(const QImage &hsvImage, Channel channel);
     static QImage convertHSVToRGB(const QImage &hChannel, const QImage &sChannel, const QImage &vChannel);
+
+    // In-place variants for callers done with their input, as in
+    // result = ImageProcessor::adjustBrightness(std::move(result)). When no
+    // other QImage shares the image its buffer is overwritten and returned,
+    // the neighborhood filters keeping only a few rows of the original (see
+    // PixelAccess::filterInPlace); otherwise, and for mirror and wrap
+    // borders, they copy like the versions above. The results are the same
+    // either way.
+    static QImage invertColors(QImage &&image);
+    static QImage adjustBrightness(QImage &&image);
+    static QImage adjustContrast(QImage &&image);
+    static QImage gammaCorrection(QImage &&image);
+    static QImage applyLookupTable(QImage &&image, const LookupTable &table);
+    static QImage applyUniformQuantization(QImage &&image, int rLevels, int gLevels, int bLevels);
+    static QImage applyConvolution(QImage &&image, const Kernel &kernel);
+    static QImage applyMedianFilter(QImage &&image, int kernelSize, const Border &border = Border());
+
+    // Planar versions of the per-channel filters. They give the planes of
+    // what the QImage versions give for PlanarImage::fromImage(image)'s
+    // packed form, but their loops walk one channel's bytes at a time.
+    static PlanarImage applyLookupTable(const PlanarImage &image, const LookupTable &table);
+    static PlanarImage applyConvolution(const PlanarImage &image, const Kernel &kernel);
+    static PlanarImage applyMedianFilter(const PlanarImage &image, int kernelSize, const Border &border = Border());
+    static PlanarImage applyOrderedDithering(const PlanarImage &image, int thresholdMapSize, int k);
+    static PlanarImage applyUniformQuantization(const PlanarImage &image, int rLevels, int gLevels, int bLevels);
+    // H, S and V planes, whose PlanarImage::plane() views are the channels
+    // extractChannel() would take from convertToHSV(), without a copy.
+    static PlanarImage convertToHSV(const PlanarImage &image);
+    static QImage convertHSVToRGB(const PlanarImage &hsvImage);
+
+    // Region of interest variants: only the pixels inside region are
+    // filtered and the rest of the image is returned unchanged. The filters
+    // read the pixels around the region they need (the whole image under a
+    // mirror or wrap border), so the region comes out exactly as in the
+    // result for the whole image. A filter that changes
+    // the format (greyscale, or any filter of a Grayscale8 image) returns a
+    // WorkingFormat image.
+    static QImage applyLookupTable(const QImage &image, const LookupTable &table, const QRect &region);
+    static QImage applyConvolution(const QImage &image, const Kernel &kernel, const QRect &region);
+    static QImage applyMedianFilter(const QImage &image, int kernelSize, const QRect &region, const Border &border = Border());
+    static QImage applyOrderedDithering(const QImage &image, int thresholdMapSize, int k, const QRect &region);
+    static QImage applyGreyscaleFilter(const QImage &image, const QRect &region);
+
+    // The part of an image of imageSize that a filter has to see to produce
+    // region: the region grown by the pixels the filter reads around each
+    // output pixel, and moved to a multiple of period so position-dependent
+    // patterns (ordered dithering's threshold map) line up as in the whole
+    // image.
+    static QRect regionSource(const QRect &region, const QMargins &margins, int period, const QSize &imageSize);
+    // image with region replaced by the same pixels of patch, a result whose
+    // top-left pixel lies at patchOrigin in image.
+    static QImage pasteRegion(const QImage &image, const QRect &region, const QImage &patch, const QPoint &patchOrigin);
 };
 
 #endif // IMAGEPROCESSOR_H
@@ -4,18 +4,39 @@
 #include <QVector>
 #include <QString>
 #include <ostream>
+#include "border.h"
 
 
 class Kernel
 {
+    public:
+        // A non-zero coefficient and its position, in row-major order.
+        struct Tap
+        {
+            int row;
+            int col;
+            int weight;
+        };
+
     private:
-    int rows;
-    int cols;
-    QVector<QVector<int>> kernel;
-    int divisor;
-    int offset;
-    int anchorX;
-    int anchorY;
+    int rows = 0;
+    int cols = 0;
+    QVector<int> coefficients;
+    int divisor = 1;
+    int offset = 0;
+    int anchorX = 0;
+    int anchorY = 0;
+    Border border;
+    double factor = 1.0;
+    int sum = 0;
+    QVector<Tap> taps;
+    int boxWeight = 0;
+    bool separable = false;
+    QVector<int> horizontalKernel;
+    QVector<int> verticalKernel;
+
+    void initialize();
+    void detectSeparability();
 
     public:
         Kernel();
@@ -23,13 +44,50 @@ class Kernel
         Kernel(int rows, int cols, QVector<QVector<int>> kernel, int divisor, int offset, int anchorX, int anchorY);
         ~Kernel();
 
+        // Copies the coefficients into a table; prefer data() or row() in
+        // filter loops.
         QVector<QVector<int>> getKernel() const;
         int getDivisor() const;
         int getOffset() const;
+        // The anchor is the kernel cell placed over the output pixel:
+        // getAnchorX() is its row and getAnchorY() its column.
         int getAnchorX() const;
         int getAnchorY() const;
         int getRows() const;
         int getCols() const;
+
+        // What the kernel reads beyond the image edges, clamp unless set
+        // here or named on the line after the anchor in a .flt file.
+        const Border &getBorder() const;
+        void setBorder(const Border &border);
+
+        // Row-major coefficients, rows * cols values in one allocation.
+        const int *data() const { return coefficients.constData(); }
+        const int *row(int r) const { return coefficients.constData() + r * cols; }
+        int at(int r, int c) const { return coefficients[r * cols + c]; }
+
+        // 1.0 / divisor, the same double every filter scales its sums by.
+        double getFactor() const;
+        int getSum() const;
+        const QVector<Tap> &getTaps() const;
+
+        // A box kernel has the same non-zero coefficient in every cell, like
+        // blur.flt; getBoxWeight() is that coefficient, 0 for other kernels.
+        bool isBox() const;
+        int getBoxWeight() const;
+
+        // A kernel is separable when it is the outer product of an integer
+        // column vector (getVerticalKernel(), one entry per row) and an
+        // integer row vector (getHorizontalKernel(), one entry per column).
+        bool isSeparable() const;
+        const QVector<int> &getHorizontalKernel() const;
+        const QVector<int> &getVerticalKernel() const;
+
+        // The same kernel resampled to newRows x newCols (at most the current
+        // size) for use on a downscaled image: every coefficient is added to
+        // the cell it falls into, so the sum, divisor, offset and border are
+        // kept and the anchor moves with its cell.
+        Kernel resampled(int newRows, int newCols) const;
 };
 
-#endif // KERNEL_H
\ No newline at end of file
+#endif // KERNEL_H
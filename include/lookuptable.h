@@ -0,0 +1,51 @@
+#ifndef LOOKUPTABLE_H
+#define LOOKUPTABLE_H
+
+#include <QImage>
+#include <array>
+#include <functional>
+
+// Per-channel 256-entry table describing a point operation on 8-bit RGB.
+// Point filters are compiled into a table once and applied in a single
+// lookup pass; consecutive point filters compose into one table so a chain
+// of them still costs one pass over the image.
+class LookupTable
+{
+public:
+    using ChannelFunction = std::function<int(int value)>;
+
+    LookupTable();
+    explicit LookupTable(const ChannelFunction &function);
+    LookupTable(const ChannelFunction &red, const ChannelFunction &green, const ChannelFunction &blue);
+
+    // Table equivalent to applying this table and then next.
+    LookupTable then(const LookupTable &next) const;
+
+    bool isIdentity() const;
+    bool isGray() const;
+
+    uchar red(int value) const { return redTable[value]; }
+    uchar green(int value) const { return greenTable[value]; }
+    uchar blue(int value) const { return blueTable[value]; }
+
+    QImage apply(const QImage &image) const;
+    // Maps image in place when nothing else shares it.
+    QImage apply(QImage &&image) const;
+    // The mapping apply() makes for WorkingFormat pixels, on one row; src and
+    // dst may be the same.
+    void mapRow(const QRgb *src, QRgb *dst, int count) const;
+    // The same for one row of a channel plane (0 red, 1 green, 2 blue); src
+    // and dst may be the same.
+    void mapChannelRow(int channel, const uchar *src, uchar *dst, int count) const;
+
+private:
+    using Table = std::array<uchar, 256>;
+
+    static Table build(const ChannelFunction &function);
+
+    Table redTable;
+    Table greenTable;
+    Table blueTable;
+};
+
+#endif // LOOKUPTABLE_H
@@ -11,7 +11,18 @@
 #include <QImage>
 #include <QSpinBox>
 #include <QComboBox>
+#include <QProgressBar>
+#include <QCheckBox>
+#include <QRubberBand>
+#include <QRegion>
+#include <QTransform>
+#include <QThreadPool>
+#include <memory>
 #include "kernel.h"
+#include "filteroperation.h"
+#include "filterhistory.h"
+#include "filtercache.h"
+#include "tilescheduler.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -20,10 +31,15 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
 private slots:
     void loadImage();
     void saveImage();
     void resetImage();
+    void undoFilter();
+    void redoFilter();
 
     void applyInversionFilter();
     void applyBrightnessFilter();
@@ -46,6 +62,9 @@ private slots:
 
     void applyHSVFilter();
 
+    void cancelFilter();
+    void setRegionMode(bool enabled);
+
 private:
     QLabel *originalImageLabel;
     QLabel *filteredImageLabel;
@@ -78,8 +97,78 @@ private:
 
     QSpinBox *ditheringQuantizationSpinBox;
 
-    void updateFilteredImage(const QImage &newImage);
+    QProgressBar *filterProgressBar;
+    QPushButton *cancelFilterButton;
+    QPushButton *undoButton;
+    QPushButton *redoButton;
+    QCheckBox *regionCheckBox;
+    QRubberBand *selectionBand;
+
+    // Filters are first applied to previewImage, a copy of the result scaled
+    // to the view, and queued in pendingFilters. The filtered view shows
+    // previewImage at its own size. filterPool then refines the filters on
+    // the full-resolution filteredImage, committing a result only when its
+    // generation is still the latest.
+    QImage previewImage;
+    double previewScale = 1.0;
+    QVector<FilterOperation> pendingFilters;
+
+    // Every filter applied since loading or resetting, for undo and redo.
+    // filteredImage is history state committedState, and pendingFilters
+    // lead from it to the current state. The previews are small, so one is
+    // kept per state in previewStates: stepping through the history shows
+    // them at once while evicted full-resolution states are replayed in the
+    // background.
+    FilterHistory history;
+    int committedState = 0;
+    QVector<QImage> previewStates;
+
+    // Previews and refinements go through filterCache, so reapplying a
+    // filter to an image it has already seen is a lookup.
+    FilterCache filterCache;
+    QThreadPool filterPool;
+    std::shared_ptr<TileScheduler::Task> filterTask;
+    quint64 filterGeneration = 0;
+    std::shared_ptr<TileScheduler::Task> hsvTask;
+    quint64 hsvGeneration = 0;
+
+    // In region mode the pending filters are applied at full resolution
+    // only to the selection dragged on the filtered view, or without one to
+    // its visible part, and painted scaled down over the preview in
+    // filteredPixmap; refinedRegion is what has been painted so far, in
+    // image coordinates like selection. The rest follows when
+    // it is scrolled into view, and the whole image when it is saved.
+    QRect selection;
+    QPoint selectionStart;
+    QPixmap filteredPixmap;
+    QRegion refinedRegion;
+
+    // A save waits for the refinement to commit history state saveState,
+    // the state shown when it was asked for, and then writes it to
+    // saveFileName; empty when no save is pending.
+    QString saveFileName;
+    int saveState = 0;
+
+    void saveFilteredImage();
+    void resetHistory();
+    void showHistoryState();
+    void updateHistoryButtons();
     void openFilterEditorDialog();
+
+    QImage scaledForPreview(const QImage &image) const;
+    void showPreview();
+    QTransform imageToView() const;
+    QRect viewToImage(const QRect &rect) const;
+    void startFilter(const FilterOperation &operation);
+    void startRefinement();
+    void finishRefinement(quint64 generation, int filterCount, const QImage &result, const QImage &view, const QString &error);
+    QRect visibleImageRect() const;
+    void startRegionRefinement();
+    void finishRegionRefinement(quint64 generation, const QRect &region, const QImage &patch, const QString &error);
+    void cancelRefinement();
+    void showFilterProgress(quint64 generation, double progress);
+    void discardPendingFilters();
+    void cancelHSVFilter();
 };
 
 #endif // MAINWINDOW_H
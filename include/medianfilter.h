@@ -0,0 +1,32 @@
+#ifndef MEDIANFILTER_H
+#define MEDIANFILTER_H
+
+#include <QImage>
+#include "border.h"
+#include "pixelaccess.h"
+#include "planarimage.h"
+
+// Median filter engine behind ImageProcessor::applyMedianFilter. Windows up
+// to LARGEST_NETWORK_SIZE (3x3 and 5x5) are reduced with fixed sorting
+// networks evaluated over a run of pixels at once. Every other size uses a
+// per-channel sliding histogram (Huang), whose cost per pixel grows with the
+// kernel size rather than with its area.
+class MedianFilter
+{
+public:
+    static const int LARGEST_NETWORK_SIZE = 5;
+
+    // border is what windows reaching past the image edges read.
+    static QImage apply(const QImage &image, int kernelSize, const Border &border);
+    // Overwrites image when nothing else shares it (PixelAccess::filterInPlace)
+    // and the border is local (Border::isLocal()).
+    static QImage apply(QImage &&image, int kernelSize, const Border &border);
+    static PlanarImage apply(const PlanarImage &image, int kernelSize, const Border &border);
+
+    // Medians of rows [firstRow, lastRow) for kernelSize > 1, in the
+    // PixelAccess::RowsFunction form.
+    static void filterRows(const PixelAccess::ConstRowFunction &sourceRow, const PixelAccess::RowFunction &resultRow, int width, int height,
+                           int kernelSize, const Border &border, int firstRow, int lastRow);
+};
+
+#endif // MEDIANFILTER_H
@@ -0,0 +1,101 @@
+#ifndef PIXELACCESS_H
+#define PIXELACCESS_H
+
+#include <QImage>
+#include <functional>
+#include "border.h"
+#include "tilescheduler.h"
+
+// Shared raw pixel access for the ImageProcessor filters. Inputs are
+// normalized once to WorkingFormat (packed 0xAARRGGBB words) so the filters
+// can walk constScanLine()/scanLine() rows directly instead of paying for a
+// QColor round trip and a format dispatch on every sample.
+class PixelAccess
+{
+public:
+    static constexpr QImage::Format WorkingFormat = QImage::Format_ARGB32;
+
+    static QImage normalized(const QImage &image);
+    static QImage createResult(const QSize &size);
+
+    static inline const QRgb *constRow(const QImage &image, int y)
+    {
+        return reinterpret_cast<const QRgb *>(image.constScanLine(y));
+    }
+
+    // Splits a row into red, green and blue byte planes that extend padLeft
+    // pixels before it and paddedWidth - width - padLeft pixels after it,
+    // so neighborhood loops can index the planes without bounds checks. The
+    // row itself is copied straight across; only the padding goes through
+    // border. A null src is a row beyond the top or bottom edge under a
+    // Constant border and is filled with its value.
+    static void splitPaddedRow(const QRgb *src, int width, int padLeft, int paddedWidth, uchar *red, uchar *green, uchar *blue,
+                               const Border &border);
+    // The same padding for a row of one byte plane.
+    static void padRow(const uchar *src, int width, int padLeft, int paddedWidth, uchar *dst, const Border &border);
+
+    // Writable rows resolved from a single QImage::bits() call. The
+    // non-const scanLine() detaches on every call, which must not happen
+    // concurrently, so banded filters take their destination rows from here.
+    template <typename Pixel>
+    struct RowWriter
+    {
+        uchar *bits;
+        qsizetype bytesPerLine;
+
+        inline Pixel *operator()(int y) const
+        {
+            return reinterpret_cast<Pixel *>(bits + y * bytesPerLine);
+        }
+    };
+
+    template <typename Pixel = QRgb>
+    static RowWriter<Pixel> rows(QImage &image)
+    {
+        return {image.bits(), image.bytesPerLine()};
+    }
+
+    // Rows of a WorkingFormat image, by row index.
+    using ConstRowFunction = std::function<const QRgb *(int y)>;
+    using RowFunction = std::function<QRgb *(int y)>;
+    // Computes rows [firstRow, lastRow) of a neighborhood filter's result,
+    // reading source rows through sourceRow (only for y in [0, height)) and
+    // writing the result rows through resultRow.
+    using RowsFunction = std::function<void(const ConstRowFunction &sourceRow, const RowFunction &resultRow, int firstRow, int lastRow)>;
+
+    // Whether a filter may overwrite image instead of allocating a result:
+    // it is not shared with another QImage and is in WorkingFormat (RGB32,
+    // whose alpha is always 0xff, is reinterpreted as such).
+    static bool prepareInPlace(QImage &image);
+
+    // Runs a neighborhood filter reading up to haloAbove rows above and
+    // haloBelow rows below each output row over image in place, after
+    // prepareInPlace() said yes. Each band works through strips of a few
+    // rows, keeping only the haloAbove original rows it has already
+    // overwritten; the rows next to band boundaries are copied up front.
+    // The result equals running the filter into a separate image.
+    static void filterInPlace(QImage &image, int haloAbove, int haloBelow, const RowsFunction &function);
+
+    // Applies op(QRgb) -> QRgb to every pixel of image and returns the result
+    // in WorkingFormat.
+    template <typename PixelOp>
+    static QImage mapPixels(const QImage &image, PixelOp op)
+    {
+        const QImage source = normalized(image);
+        QImage result = createResult(source.size());
+        const RowWriter<QRgb> resultRows = rows(result);
+        const int width = source.width();
+        TileScheduler::forEachBand(source.height(), 0, [&](int firstRow, int lastRow)
+                                   {
+            for (int y = firstRow; y < lastRow; ++y)
+            {
+                const QRgb *src = constRow(source, y);
+                QRgb *dst = resultRows(y);
+                for (int x = 0; x < width; ++x)
+                    dst[x] = op(src[x]);
+            } });
+        return result;
+    }
+};
+
+#endif // PIXELACCESS_H
@@ -0,0 +1,60 @@
+#ifndef PLANARIMAGE_H
+#define PLANARIMAGE_H
+
+#include <QImage>
+#include <QSize>
+#include <memory>
+
+// An image stored as three separate 8-bit planes (red, green and blue, or
+// H, S and V after ImageProcessor::convertToHSV) instead of packed pixels.
+// Every filter treats the channels independently, so on planes their inner
+// loops read and write contiguous bytes of one channel. Rows start on
+// ALIGNMENT-byte boundaries and are padded to a multiple of it.
+//
+// Copies share the pixel buffer; row() detaches first if it is shared, so
+// call it on a result before handing its rows to other threads, as with
+// PixelAccess::rows().
+class PlanarImage
+{
+public:
+    static const int CHANNELS = 3;
+    static const int ALIGNMENT = 64;
+
+    PlanarImage();
+    // Uninitialized planes of the given size.
+    explicit PlanarImage(const QSize &size);
+
+    // Splits image, in any format, in one pass; alpha is dropped.
+    static PlanarImage fromImage(const QImage &image);
+    // Interleaves the planes into an opaque WorkingFormat image in one pass.
+    QImage toImage() const;
+
+    bool isNull() const;
+    int width() const;
+    int height() const;
+    QSize size() const;
+    // Bytes from one row of a plane to the next.
+    qsizetype stride() const;
+
+    const uchar *constRow(int channel, int y) const
+    {
+        return pixels + (channel * planeRows + y) * rowStride;
+    }
+    uchar *row(int channel, int y);
+
+    // Channel as a Grayscale8 image sharing this buffer without a copy. The
+    // view keeps the buffer alive and is read-only: writing to it detaches
+    // the QImage, and row() detaches this image while a view exists.
+    QImage plane(int channel) const;
+
+private:
+    void detach();
+
+    std::shared_ptr<uchar> buffer;
+    uchar *pixels = nullptr;
+    int planeColumns = 0;
+    int planeRows = 0;
+    qsizetype rowStride = 0;
+};
+
+#endif // PLANARIMAGE_H
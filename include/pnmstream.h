@@ -0,0 +1,51 @@
+#ifndef PNMSTREAM_H
+#define PNMSTREAM_H
+
+#include <QFile>
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+// Binary PGM (P5) and PPM (P6) files with 8-bit samples, read and written a
+// few rows at a time, so images too large to decode up front can be streamed
+// through FilterPipeline::applyStrips. Both classes throw std::runtime_error
+// on malformed or truncated files and on I/O errors.
+class PnmReader
+{
+public:
+    explicit PnmReader(const QString &path);
+
+    QSize size() const;
+    bool isGrey() const;
+
+    // The next rowCount rows: a Grayscale8 image for a PGM file, a
+    // WorkingFormat one for a PPM file.
+    QImage readRows(int rowCount);
+
+private:
+    QFile file;
+    QSize imageSize;
+    int channels = 0;
+    int nextRow = 0;
+};
+
+class PnmWriter
+{
+public:
+    // Writes a PGM file when grey is set and a PPM file otherwise.
+    PnmWriter(const QString &path, const QSize &size, bool grey);
+
+    // Appends rows [firstRow, firstRow + rowCount) of image. Alpha is
+    // dropped, and colours are reduced with qGray() for a PGM file.
+    void writeRows(const QImage &image, int firstRow, int rowCount);
+    // Closes the file; throws unless every row has been written.
+    void finish();
+
+private:
+    QFile file;
+    QSize imageSize;
+    int channels = 0;
+    int nextRow = 0;
+};
+
+#endif // PNMSTREAM_H
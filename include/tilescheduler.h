@@ -0,0 +1,87 @@
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+
+// Splits image rows into horizontal bands and runs them on a shared thread
+// pool. Every band writes a disjoint range of output rows and only reads the
+// (immutable) source image, so the result is identical to a serial run no
+// matter how the bands are scheduled.
+class TileScheduler
+{
+public:
+    // Processes rows [firstRow, lastRow).
+    using BandFunction = std::function<void(int firstRow, int lastRow)>;
+
+    // Thrown out of forEachBand once the current task has been cancelled.
+    class Cancelled : public std::runtime_error
+    {
+    public:
+        Cancelled();
+    };
+
+    // Cooperative cancellation and progress for one filter run. Install it
+    // with a TaskScope on the thread that calls the filter: every
+    // forEachBand underneath checks it before each band, throwing Cancelled,
+    // and reports finished rows. Each forEachBand call counts as one pass, so
+    // a filter made of several passes should say how many it expects.
+    class Task
+    {
+    public:
+        // Called from worker threads with the overall progress in [0, 1].
+        using ProgressFunction = std::function<void(double progress)>;
+
+        explicit Task(int passes = 1, ProgressFunction onProgress = ProgressFunction());
+
+        void cancel();
+        bool isCancelled() const;
+        double progress() const;
+
+        // Called by forEachBand.
+        void beginPass(int rows);
+        void finishRows(int rows);
+
+    private:
+        const int passes;
+        const ProgressFunction onProgress;
+        std::atomic<bool> cancelled{false};
+        std::atomic<int> startedPasses{0};
+        std::atomic<int> passRows{0};
+        std::atomic<int> finishedPassRows{0};
+    };
+
+    // Makes task the current task of the calling thread for its lifetime.
+    class TaskScope
+    {
+    public:
+        explicit TaskScope(Task *task);
+        ~TaskScope();
+
+        TaskScope(const TaskScope &) = delete;
+        TaskScope &operator=(const TaskScope &) = delete;
+
+    private:
+        Task *previous;
+    };
+
+    // 0 selects QThread::idealThreadCount(); 1 runs everything on the
+    // calling thread.
+    static void setThreadCount(int count);
+    static int threadCount();
+
+    // haloRows is how far a band reads above and below its own rows (for
+    // example a kernel radius). Bands are kept several halos tall so the
+    // overlapping reads stay a small fraction of the work.
+    static void forEachBand(int rows, int haloRows, const BandFunction &function);
+
+    // The band height forEachBand(rows, haloRows, ...) picks for the
+    // current thread count and task; every band but the last is that tall.
+    static int bandRows(int rows, int haloRows);
+    // forEachBand with a band height chosen by the caller, for filters that
+    // prepare something per band boundary before the bands run.
+    static void forEachBandOf(int rows, int bandRows, const BandFunction &function);
+};
+
+#endif // TILESCHEDULER_H
@@ -0,0 +1,41 @@
+# Image processing core shared by the GUI application and the tools built
+# on top of it. Contains no widget code.
+
+INCLUDEPATH += $$PWD/include
+
+SOURCES += \
+    $$PWD/src/border.cpp \
+    $$PWD/src/kernel.cpp \
+    $$PWD/src/imagebufferpool.cpp \
+    $$PWD/src/pixelaccess.cpp \
+    $$PWD/src/planarimage.cpp \
+    $$PWD/src/lookuptable.cpp \
+    $$PWD/src/tilescheduler.cpp \
+    $$PWD/src/convolutionkernels.cpp \
+    $$PWD/src/fft.cpp \
+    $$PWD/src/medianfilter.cpp \
+    $$PWD/src/filteroperation.cpp \
+    $$PWD/src/filterpipeline.cpp \
+    $$PWD/src/filterhistory.cpp \
+    $$PWD/src/filtercache.cpp \
+    $$PWD/src/pnmstream.cpp \
+    $$PWD/src/imageprocessor.cpp
+
+HEADERS += \
+    $$PWD/include/filterconstants.h \
+    $$PWD/include/border.h \
+    $$PWD/include/kernel.h \
+    $$PWD/include/imagebufferpool.h \
+    $$PWD/include/pixelaccess.h \
+    $$PWD/include/planarimage.h \
+    $$PWD/include/lookuptable.h \
+    $$PWD/include/tilescheduler.h \
+    $$PWD/include/convolutionkernels.h \
+    $$PWD/include/fft.h \
+    $$PWD/include/medianfilter.h \
+    $$PWD/include/filteroperation.h \
+    $$PWD/include/filterpipeline.h \
+    $$PWD/include/filterhistory.h \
+    $$PWD/include/filtercache.h \
+    $$PWD/include/pnmstream.h \
+    $$PWD/include/imageprocessor.h
@@ -0,0 +1,105 @@
+#include "border.h"
+#include <QtGlobal>
+#include <stdexcept>
+
+Border::Border()
+    : borderMode(Mode::Clamp), constantValue(0)
+{
+}
+
+Border::Border(Mode mode, int value)
+    : borderMode(mode), constantValue(value)
+{
+    if (value < 0 || value > 255 || (mode != Mode::Constant && value != 0))
+        throw std::runtime_error("Border value must be a grey level in [0, 255] and only given for a constant border");
+}
+
+Border::Mode Border::mode() const
+{
+    return borderMode;
+}
+
+int Border::value() const
+{
+    return constantValue;
+}
+
+int Border::map(int i, int size) const
+{
+    if (i >= 0 && i < size)
+        return i;
+    switch (borderMode)
+    {
+    case Mode::Clamp:
+        return qBound(0, i, size - 1);
+    case Mode::Mirror:
+    {
+        if (size == 1)
+            return 0;
+        // Reflection about both edges repeats every 2 * (size - 1) pixels,
+        // which also covers windows wider than the image.
+        const int period = 2 * (size - 1);
+        i %= period;
+        if (i < 0)
+            i += period;
+        return i < size ? i : period - i;
+    }
+    case Mode::Wrap:
+        i %= size;
+        return i < 0 ? i + size : i;
+    case Mode::Constant:
+        return -1;
+    }
+    return -1;
+}
+
+bool Border::isLocal() const
+{
+    return borderMode == Mode::Clamp || borderMode == Mode::Constant;
+}
+
+Border Border::parse(const QString &text)
+{
+    const QString trimmed = text.trimmed();
+    if (trimmed == "clamp")
+        return Border();
+    if (trimmed == "mirror")
+        return Border(Mode::Mirror);
+    if (trimmed == "wrap")
+        return Border(Mode::Wrap);
+    if (trimmed.section(':', 0, 0) == "constant")
+    {
+        const QString level = trimmed.section(':', 1);
+        bool ok = level.isEmpty();
+        const int value = ok ? 0 : level.toInt(&ok);
+        if (ok && value >= 0 && value <= 255)
+            return Border(Mode::Constant, value);
+    }
+    throw std::runtime_error("Invalid border '" + trimmed.toStdString() + "', expected clamp, mirror, wrap or constant:<0-255>");
+}
+
+QString Border::name() const
+{
+    switch (borderMode)
+    {
+    case Mode::Clamp:
+        return "clamp";
+    case Mode::Mirror:
+        return "mirror";
+    case Mode::Wrap:
+        return "wrap";
+    case Mode::Constant:
+        return QString("constant:%1").arg(constantValue);
+    }
+    return QString();
+}
+
+bool Border::operator==(const Border &other) const
+{
+    return borderMode == other.borderMode && constantValue == other.constantValue;
+}
+
+bool Border::operator!=(const Border &other) const
+{
+    return !(*this == other);
+}
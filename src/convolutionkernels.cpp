@@ -0,0 +1,513 @@
+#include "convolutionkernels.h"
+#include "filterconstants.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <utility>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CONVOLUTION_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    struct Implementation
+    {
+        ConvolutionKernels::InstructionSet instructionSet;
+        void (*multiplyAccumulateBytes)(int *, const uchar *, int, int);
+        void (*multiplyAccumulateInts)(int *, const int *, int, int);
+        void (*storePixels)(QRgb *, const int *, const int *, const int *, double, int, int);
+        void (*storeChannel)(uchar *, const int *, double, int, int);
+        ConvolutionKernels::WindowFunction (*windowFunction)(int, const int *);
+    };
+
+    inline int convolutionChannel(int sum, double factor, int bias)
+    {
+        return qBound(0, static_cast<int>(factor * sum + bias), 255);
+    }
+
+    void multiplyAccumulateBytesScalar(int *acc, const uchar *values, int weight, int count)
+    {
+        for (int i = 0; i < count; ++i)
+            acc[i] += weight * values[i];
+    }
+
+    void multiplyAccumulateIntsScalar(int *acc, const int *values, int weight, int count)
+    {
+        for (int i = 0; i < count; ++i)
+            acc[i] += weight * values[i];
+    }
+
+    void storePixelsScalar(QRgb *dst, const int *red, const int *green, const int *blue, double factor, int bias, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            dst[i] = qRgb(convolutionChannel(red[i], factor, bias),
+                          convolutionChannel(green[i], factor, bias),
+                          convolutionChannel(blue[i], factor, bias));
+        }
+    }
+
+    void storeChannelScalar(uchar *dst, const int *sums, double factor, int bias, int count)
+    {
+        for (int i = 0; i < count; ++i)
+            dst[i] = static_cast<uchar>(convolutionChannel(sums[i], factor, bias));
+    }
+
+    // Coefficients of a window function: compiled in from one of the
+    // constexpr kernels of filterconstants.h, or passed at run time.
+    template <int Size, const int (&Coefficients)[Size][Size]>
+    struct CompiledWeights
+    {
+        static constexpr bool compiled = true;
+        static constexpr int at(int tap) { return Coefficients[tap / Size][tap % Size]; }
+    };
+
+    struct RuntimeWeights
+    {
+        static constexpr bool compiled = false;
+        static constexpr int at(int) { return 0; }
+    };
+
+    // log2 of a power of two, -1 for any other value.
+    constexpr int exactShift(int value)
+    {
+        if (value <= 0 || (value & (value - 1)) != 0)
+            return -1;
+        int shift = 0;
+        while ((1 << shift) < value)
+            ++shift;
+        return shift;
+    }
+
+    // The window functions expand the taps, tap = r * Size + c, with fold
+    // expressions over std::integer_sequence, so every one is a separate
+    // statement with its row, column and (compiled) weight as constants.
+    template <int Size, typename Weights, int Tap>
+    inline int windowTapScalar(const uchar *const *rows, int i, const int *coefficients)
+    {
+        const int value = rows[Tap / Size][i + Tap % Size];
+        if constexpr (Weights::compiled)
+            return Weights::at(Tap) * value;
+        else
+            return coefficients[Tap] * value;
+    }
+
+    template <int Size, typename Weights, int... Taps>
+    inline int windowPixelScalar(const uchar *const *rows, int i, const int *coefficients, std::integer_sequence<int, Taps...>)
+    {
+        return (windowTapScalar<Size, Weights, Taps>(rows, i, coefficients) + ...);
+    }
+
+    template <int Size, typename Weights>
+    void windowScalar(int *sums, const uchar *const *rows, const int *coefficients, int first, int count)
+    {
+        for (int i = first; i < count; ++i)
+            sums[i] = windowPixelScalar<Size, Weights>(rows, i, coefficients, std::make_integer_sequence<int, Size * Size>());
+    }
+
+    template <int Size, typename Weights>
+    struct ScalarWindow
+    {
+        static void run(int *sums, const uchar *const *rows, const int *coefficients, int count)
+        {
+            windowScalar<Size, Weights>(sums, rows, coefficients, 0, count);
+        }
+    };
+
+    template <int Size>
+    bool sameCoefficients(const int (&kernel)[Size][Size], const int *coefficients)
+    {
+        return std::equal(&kernel[0][0], &kernel[0][0] + Size * Size, coefficients);
+    }
+
+    // The window function of one instruction set, Window<Size, Weights>::run.
+    template <template <int, typename> class Window>
+    ConvolutionKernels::WindowFunction windowFor(int size, const int *coefficients)
+    {
+        if (size == 3)
+        {
+            if (sameCoefficients(BLUR_KERNEL, coefficients))
+                return Window<3, CompiledWeights<3, BLUR_KERNEL>>::run;
+            if (sameCoefficients(SHARPEN_KERNEL, coefficients))
+                return Window<3, CompiledWeights<3, SHARPEN_KERNEL>>::run;
+            if (sameCoefficients(EDGE_DETECTION_KERNEL, coefficients))
+                return Window<3, CompiledWeights<3, EDGE_DETECTION_KERNEL>>::run;
+            if (sameCoefficients(EMBOSS_KERNEL, coefficients))
+                return Window<3, CompiledWeights<3, EMBOSS_KERNEL>>::run;
+            return Window<3, RuntimeWeights>::run;
+        }
+        if (size == 5)
+        {
+            if (sameCoefficients(GAUSSIAN_BLUR_KERNEL, coefficients))
+                return Window<5, CompiledWeights<5, GAUSSIAN_BLUR_KERNEL>>::run;
+            return Window<5, RuntimeWeights>::run;
+        }
+        return nullptr;
+    }
+
+#ifdef CONVOLUTION_X86_SIMD
+    // The SIMD versions compute factor * sum + bias as a separate multiply
+    // and add in double precision and truncate toward zero, which is exactly
+    // what the scalar static_cast<int>(factor * sum + bias) does.
+
+    __attribute__((target("sse4.1"))) void multiplyAccumulateBytesSse41(int *acc, const uchar *values, int weight, int count)
+    {
+        const __m128i w = _mm_set1_epi32(weight);
+        int i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            int packed;
+            std::memcpy(&packed, values + i, sizeof(packed));
+            const __m128i v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(acc + i), _mm_add_epi32(a, _mm_mullo_epi32(v, w)));
+        }
+        multiplyAccumulateBytesScalar(acc + i, values + i, weight, count - i);
+    }
+
+    __attribute__((target("sse4.1"))) void multiplyAccumulateIntsSse41(int *acc, const int *values, int weight, int count)
+    {
+        const __m128i w = _mm_set1_epi32(weight);
+        int i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(acc + i), _mm_add_epi32(a, _mm_mullo_epi32(v, w)));
+        }
+        multiplyAccumulateIntsScalar(acc + i, values + i, weight, count - i);
+    }
+
+    __attribute__((target("sse4.1"))) inline __m128i scaleChannelSse41(const int *sums, __m128d factor, __m128d bias)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sums));
+        const __m128d low = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(v), factor), bias);
+        const __m128d high = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(v, v)), factor), bias);
+        const __m128i scaled = _mm_unpacklo_epi64(_mm_cvttpd_epi32(low), _mm_cvttpd_epi32(high));
+        return _mm_min_epi32(_mm_max_epi32(scaled, _mm_setzero_si128()), _mm_set1_epi32(255));
+    }
+
+    __attribute__((target("sse4.1"))) void storePixelsSse41(QRgb *dst, const int *red, const int *green, const int *blue, double factor, int bias, int count)
+    {
+        const __m128d f = _mm_set1_pd(factor);
+        const __m128d b = _mm_set1_pd(bias);
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000u));
+        int i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128i r = scaleChannelSse41(red + i, f, b);
+            const __m128i g = scaleChannelSse41(green + i, f, b);
+            const __m128i bl = scaleChannelSse41(blue + i, f, b);
+            const __m128i pixels = _mm_or_si128(_mm_or_si128(alpha, _mm_slli_epi32(r, 16)), _mm_or_si128(_mm_slli_epi32(g, 8), bl));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), pixels);
+        }
+        storePixelsScalar(dst + i, red + i, green + i, blue + i, factor, bias, count - i);
+    }
+
+    __attribute__((target("sse4.1"))) void storeChannelSse41(uchar *dst, const int *sums, double factor, int bias, int count)
+    {
+        const __m128d f = _mm_set1_pd(factor);
+        const __m128d b = _mm_set1_pd(bias);
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m128i words = _mm_packus_epi32(scaleChannelSse41(sums + i, f, b), scaleChannelSse41(sums + i + 4, f, b));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(words, words));
+        }
+        storeChannelScalar(dst + i, sums + i, factor, bias, count - i);
+    }
+
+    __attribute__((target("avx2"))) void multiplyAccumulateBytesAvx2(int *acc, const uchar *values, int weight, int count)
+    {
+        const __m256i w = _mm256_set1_epi32(weight);
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(values + i)));
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + i), _mm256_add_epi32(a, _mm256_mullo_epi32(v, w)));
+        }
+        multiplyAccumulateBytesScalar(acc + i, values + i, weight, count - i);
+    }
+
+    __attribute__((target("avx2"))) void multiplyAccumulateIntsAvx2(int *acc, const int *values, int weight, int count)
+    {
+        const __m256i w = _mm256_set1_epi32(weight);
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + i), _mm256_add_epi32(a, _mm256_mullo_epi32(v, w)));
+        }
+        multiplyAccumulateIntsScalar(acc + i, values + i, weight, count - i);
+    }
+
+    __attribute__((target("avx2"))) inline __m256i scaleChannelAvx2(const int *sums, __m256d factor, __m256d bias)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sums));
+        const __m256d low = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), factor), bias);
+        const __m256d high = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), factor), bias);
+        const __m256i scaled = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(low)), _mm256_cvttpd_epi32(high), 1);
+        return _mm256_min_epi32(_mm256_max_epi32(scaled, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+    }
+
+    __attribute__((target("avx2"))) void storePixelsAvx2(QRgb *dst, const int *red, const int *green, const int *blue, double factor, int bias, int count)
+    {
+        const __m256d f = _mm256_set1_pd(factor);
+        const __m256d b = _mm256_set1_pd(bias);
+        const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xff000000u));
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i r = scaleChannelAvx2(red + i, f, b);
+            const __m256i g = scaleChannelAvx2(green + i, f, b);
+            const __m256i bl = scaleChannelAvx2(blue + i, f, b);
+            const __m256i pixels = _mm256_or_si256(_mm256_or_si256(alpha, _mm256_slli_epi32(r, 16)), _mm256_or_si256(_mm256_slli_epi32(g, 8), bl));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), pixels);
+        }
+        storePixelsScalar(dst + i, red + i, green + i, blue + i, factor, bias, count - i);
+    }
+
+    __attribute__((target("avx2"))) void storeChannelAvx2(uchar *dst, const int *sums, double factor, int bias, int count)
+    {
+        const __m256d f = _mm256_set1_pd(factor);
+        const __m256d b = _mm256_set1_pd(bias);
+        int i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            // packus works within 128-bit lanes, so the 32-bit pairs are
+            // put back in order before the final narrowing.
+            const __m256i words = _mm256_permute4x64_epi64(
+                _mm256_packus_epi32(scaleChannelAvx2(sums + i, f, b), scaleChannelAvx2(sums + i + 8, f, b)), 0xd8);
+            const __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), bytes);
+        }
+        storeChannelScalar(dst + i, sums + i, factor, bias, count - i);
+    }
+
+    // acc + Weight * v, as a shift where the weight is a power of two.
+    template <int Weight>
+    __attribute__((target("sse4.1"))) inline __m128i addWeightedSse41(__m128i acc, __m128i v)
+    {
+        if constexpr (Weight == 1)
+            return _mm_add_epi32(acc, v);
+        else if constexpr (Weight == -1)
+            return _mm_sub_epi32(acc, v);
+        else if constexpr (exactShift(Weight) >= 0)
+            return _mm_add_epi32(acc, _mm_slli_epi32(v, exactShift(Weight)));
+        else if constexpr (exactShift(-Weight) >= 0)
+            return _mm_sub_epi32(acc, _mm_slli_epi32(v, exactShift(-Weight)));
+        else
+            return _mm_add_epi32(acc, _mm_mullo_epi32(v, _mm_set1_epi32(Weight)));
+    }
+
+    template <int Size, typename Weights, int Tap>
+    __attribute__((target("sse4.1"))) inline __m128i windowTapSse41(__m128i acc, const uchar *const *rows, int i, const __m128i *weights)
+    {
+        if constexpr (Weights::compiled && Weights::at(Tap) == 0)
+            return acc;
+        else
+        {
+            int packed;
+            std::memcpy(&packed, rows[Tap / Size] + i + Tap % Size, sizeof(packed));
+            const __m128i v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+            if constexpr (Weights::compiled)
+                return addWeightedSse41<Weights::at(Tap)>(acc, v);
+            else
+                return _mm_add_epi32(acc, _mm_mullo_epi32(v, weights[Tap]));
+        }
+    }
+
+    template <int Size, typename Weights, int... Taps>
+    __attribute__((target("sse4.1"))) inline __m128i windowPixelsSse41(const uchar *const *rows, int i, const __m128i *weights,
+                                                                      std::integer_sequence<int, Taps...>)
+    {
+        __m128i acc = _mm_setzero_si128();
+        ((acc = windowTapSse41<Size, Weights, Taps>(acc, rows, i, weights)), ...);
+        return acc;
+    }
+
+    template <int Size, typename Weights>
+    struct Sse41Window
+    {
+        __attribute__((target("sse4.1"))) static void run(int *sums, const uchar *const *rows, const int *coefficients, int count)
+        {
+            __m128i weights[Size * Size];
+            if constexpr (!Weights::compiled)
+            {
+                for (int tap = 0; tap < Size * Size; ++tap)
+                    weights[tap] = _mm_set1_epi32(coefficients[tap]);
+            }
+            int i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                const __m128i acc = windowPixelsSse41<Size, Weights>(rows, i, weights, std::make_integer_sequence<int, Size * Size>());
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(sums + i), acc);
+            }
+            windowScalar<Size, Weights>(sums, rows, coefficients, i, count);
+        }
+    };
+
+    template <int Weight>
+    __attribute__((target("avx2"))) inline __m256i addWeightedAvx2(__m256i acc, __m256i v)
+    {
+        if constexpr (Weight == 1)
+            return _mm256_add_epi32(acc, v);
+        else if constexpr (Weight == -1)
+            return _mm256_sub_epi32(acc, v);
+        else if constexpr (exactShift(Weight) >= 0)
+            return _mm256_add_epi32(acc, _mm256_slli_epi32(v, exactShift(Weight)));
+        else if constexpr (exactShift(-Weight) >= 0)
+            return _mm256_sub_epi32(acc, _mm256_slli_epi32(v, exactShift(-Weight)));
+        else
+            return _mm256_add_epi32(acc, _mm256_mullo_epi32(v, _mm256_set1_epi32(Weight)));
+    }
+
+    template <int Size, typename Weights, int Tap>
+    __attribute__((target("avx2"))) inline __m256i windowTapAvx2(__m256i acc, const uchar *const *rows, int i, const __m256i *weights)
+    {
+        if constexpr (Weights::compiled && Weights::at(Tap) == 0)
+            return acc;
+        else
+        {
+            const __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(rows[Tap / Size] + i + Tap % Size)));
+            if constexpr (Weights::compiled)
+                return addWeightedAvx2<Weights::at(Tap)>(acc, v);
+            else
+                return _mm256_add_epi32(acc, _mm256_mullo_epi32(v, weights[Tap]));
+        }
+    }
+
+    template <int Size, typename Weights, int... Taps>
+    __attribute__((target("avx2"))) inline __m256i windowPixelsAvx2(const uchar *const *rows, int i, const __m256i *weights,
+                                                                   std::integer_sequence<int, Taps...>)
+    {
+        __m256i acc = _mm256_setzero_si256();
+        ((acc = windowTapAvx2<Size, Weights, Taps>(acc, rows, i, weights)), ...);
+        return acc;
+    }
+
+    template <int Size, typename Weights>
+    struct Avx2Window
+    {
+        __attribute__((target("avx2"))) static void run(int *sums, const uchar *const *rows, const int *coefficients, int count)
+        {
+            __m256i weights[Size * Size];
+            if constexpr (!Weights::compiled)
+            {
+                for (int tap = 0; tap < Size * Size; ++tap)
+                    weights[tap] = _mm256_set1_epi32(coefficients[tap]);
+            }
+            int i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                const __m256i acc = windowPixelsAvx2<Size, Weights>(rows, i, weights, std::make_integer_sequence<int, Size * Size>());
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums + i), acc);
+            }
+            windowScalar<Size, Weights>(sums, rows, coefficients, i, count);
+        }
+    };
+#endif
+
+    const Implementation scalarImplementation = {ConvolutionKernels::InstructionSet::Scalar, multiplyAccumulateBytesScalar,
+                                                 multiplyAccumulateIntsScalar, storePixelsScalar, storeChannelScalar,
+                                                 windowFor<ScalarWindow>};
+#ifdef CONVOLUTION_X86_SIMD
+    const Implementation sse41Implementation = {ConvolutionKernels::InstructionSet::SSE41, multiplyAccumulateBytesSse41,
+                                                multiplyAccumulateIntsSse41, storePixelsSse41, storeChannelSse41,
+                                                windowFor<Sse41Window>};
+    const Implementation avx2Implementation = {ConvolutionKernels::InstructionSet::AVX2, multiplyAccumulateBytesAvx2,
+                                               multiplyAccumulateIntsAvx2, storePixelsAvx2, storeChannelAvx2,
+                                               windowFor<Avx2Window>};
+#endif
+
+    const Implementation *implementationFor(ConvolutionKernels::InstructionSet set)
+    {
+#ifdef CONVOLUTION_X86_SIMD
+        if (set == ConvolutionKernels::InstructionSet::AVX2)
+            return &avx2Implementation;
+        if (set == ConvolutionKernels::InstructionSet::SSE41)
+            return &sse41Implementation;
+#endif
+        Q_UNUSED(set);
+        return &scalarImplementation;
+    }
+
+    ConvolutionKernels::InstructionSet detect()
+    {
+#ifdef CONVOLUTION_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return ConvolutionKernels::InstructionSet::AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return ConvolutionKernels::InstructionSet::SSE41;
+#endif
+        return ConvolutionKernels::InstructionSet::Scalar;
+    }
+
+    std::atomic<const Implementation *> &selected()
+    {
+        static std::atomic<const Implementation *> implementation{implementationFor(detect())};
+        return implementation;
+    }
+}
+
+void ConvolutionKernels::multiplyAccumulate(int *acc, const uchar *values, int weight, int count)
+{
+    selected().load(std::memory_order_relaxed)->multiplyAccumulateBytes(acc, values, weight, count);
+}
+
+void ConvolutionKernels::multiplyAccumulate(int *acc, const int *values, int weight, int count)
+{
+    selected().load(std::memory_order_relaxed)->multiplyAccumulateInts(acc, values, weight, count);
+}
+
+void ConvolutionKernels::storePixels(QRgb *dst, const int *red, const int *green, const int *blue, double factor, int bias, int count)
+{
+    selected().load(std::memory_order_relaxed)->storePixels(dst, red, green, blue, factor, bias, count);
+}
+
+void ConvolutionKernels::storeChannel(uchar *dst, const int *sums, double factor, int bias, int count)
+{
+    selected().load(std::memory_order_relaxed)->storeChannel(dst, sums, factor, bias, count);
+}
+
+ConvolutionKernels::WindowFunction ConvolutionKernels::windowFunction(int size, const int *coefficients)
+{
+    return selected().load(std::memory_order_relaxed)->windowFunction(size, coefficients);
+}
+
+ConvolutionKernels::InstructionSet ConvolutionKernels::detectedInstructionSet()
+{
+    static const InstructionSet detected = detect();
+    return detected;
+}
+
+ConvolutionKernels::InstructionSet ConvolutionKernels::instructionSet()
+{
+    return selected().load()->instructionSet;
+}
+
+void ConvolutionKernels::setInstructionSet(InstructionSet set)
+{
+    if (static_cast<int>(set) > static_cast<int>(detectedInstructionSet()))
+        set = detectedInstructionSet();
+    selected().store(implementationFor(set));
+}
+
+const char *ConvolutionKernels::instructionSetName(InstructionSet set)
+{
+    switch (set)
+    {
+    case InstructionSet::AVX2:
+        return "avx2";
+    case InstructionSet::SSE41:
+        return "sse4.1";
+    case InstructionSet::Scalar:
+        break;
+    }
+    return "scalar";
+}
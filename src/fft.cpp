@@ -0,0 +1,151 @@
+#include "fft.h"
+#include <QtGlobal>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+
+Fft::Fft(int size)
+    : length(size), reversed(size), twiddles(qMax(size - 1, 0)), inverseTwiddles(qMax(size - 1, 0))
+{
+    if (size < 1 || (size & (size - 1)) != 0)
+        throw std::runtime_error("FFT size must be a power of two");
+
+    int bits = 0;
+    while ((1 << bits) < size)
+        ++bits;
+    for (int i = 0; i < size; ++i)
+    {
+        int r = 0;
+        for (int b = 0; b < bits; ++b)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        reversed[i] = r;
+    }
+
+    // The round of butterflies over spans of 2 * half reads exp(-2 pi i k /
+    // (2 * half)) for k in [0, half) from twiddles[half - 1 + k], so every
+    // round walks its factors in order. Each is computed directly rather
+    // than by repeated multiplication so the error does not build up.
+    const double pi = std::acos(-1.0);
+    for (int half = 1; half < size; half *= 2)
+    {
+        for (int k = 0; k < half; ++k)
+        {
+            twiddles[half - 1 + k] = std::polar(1.0, -pi * k / half);
+            inverseTwiddles[half - 1 + k] = std::conj(twiddles[half - 1 + k]);
+        }
+    }
+}
+
+int Fft::size() const
+{
+    return length;
+}
+
+void Fft::forward(Complex *data) const
+{
+    transform(data, false);
+}
+
+void Fft::inverse(Complex *data) const
+{
+    transform(data, true);
+}
+
+// Iterative Cooley-Tukey: bit-reversal permutation, then log2(size) rounds of
+// butterflies. The products are written out rather than left to
+// std::complex's operator*, whose checks for infinities and NaNs cost more
+// than the butterfly itself.
+void Fft::transform(Complex *data, bool inverse) const
+{
+    for (int i = 0; i < length; ++i)
+    {
+        if (i < reversed[i])
+            std::swap(data[i], data[reversed[i]]);
+    }
+    const Complex *table = inverse ? inverseTwiddles.constData() : twiddles.constData();
+    for (int half = 1; half < length; half *= 2)
+    {
+        const Complex *factors = table + half - 1;
+        for (int start = 0; start < length; start += 2 * half)
+        {
+            Complex *even = data + start;
+            Complex *odd = even + half;
+            for (int k = 0; k < half; ++k)
+            {
+                const double re = odd[k].real() * factors[k].real() - odd[k].imag() * factors[k].imag();
+                const double im = odd[k].real() * factors[k].imag() + odd[k].imag() * factors[k].real();
+                odd[k] = Complex(even[k].real() - re, even[k].imag() - im);
+                even[k] = Complex(even[k].real() + re, even[k].imag() + im);
+            }
+        }
+    }
+}
+
+void Fft::multiply(Complex *data, const Complex *factors, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const double re = data[i].real() * factors[i].real() - data[i].imag() * factors[i].imag();
+        const double im = data[i].real() * factors[i].imag() + data[i].imag() * factors[i].real();
+        data[i] = Complex(re, im);
+    }
+}
+
+void Fft::forward2D(Complex *data, const Fft &rows, const Fft &columns)
+{
+    transform2D(data, rows, columns, false);
+}
+
+void Fft::inverse2D(Complex *data, const Fft &rows, const Fft &columns)
+{
+    transform2D(data, rows, columns, true);
+}
+
+// The columns are transformed together: each butterfly of the column
+// transform combines two whole rows, so the passes walk memory in order
+// instead of striding down one column at a time.
+void Fft::transform2D(Complex *data, const Fft &rows, const Fft &columns, bool inverse)
+{
+    const int width = rows.size();
+    const int height = columns.size();
+    for (int y = 0; y < height; ++y)
+        rows.transform(data + y * width, inverse);
+
+    for (int y = 0; y < height; ++y)
+    {
+        const int r = columns.reversed[y];
+        if (y < r)
+            std::swap_ranges(data + y * width, data + (y + 1) * width, data + r * width);
+    }
+    const Complex *table = inverse ? columns.inverseTwiddles.constData() : columns.twiddles.constData();
+    for (int half = 1; half < height; half *= 2)
+    {
+        const Complex *factors = table + half - 1;
+        for (int start = 0; start < height; start += 2 * half)
+        {
+            for (int k = 0; k < half; ++k)
+            {
+                const double wr = factors[k].real();
+                const double wi = factors[k].imag();
+                Complex *even = data + (start + k) * width;
+                Complex *odd = data + (start + k + half) * width;
+                for (int x = 0; x < width; ++x)
+                {
+                    const double re = odd[x].real() * wr - odd[x].imag() * wi;
+                    const double im = odd[x].real() * wi + odd[x].imag() * wr;
+                    odd[x] = Complex(even[x].real() - re, even[x].imag() - im);
+                    even[x] = Complex(even[x].real() + re, even[x].imag() + im);
+                }
+            }
+        }
+    }
+}
+
+int Fft::nextPowerOfTwo(int n)
+{
+    int size = 1;
+    while (size < n)
+        size *= 2;
+    return size;
+}
@@ -0,0 +1,135 @@
+#include "filtercache.h"
+#include "filterpipeline.h"
+#include <QMutexLocker>
+#include <QStringList>
+
+namespace
+{
+    // Remembered fingerprints before the table is cleared; each is a few
+    // bytes, the table only has to outlive a burst of filters on one image.
+    const int MAX_FINGERPRINTS = 64;
+}
+
+FilterCache::FilterCache(qint64 memoryBudget)
+    : budget(memoryBudget)
+{
+}
+
+QImage FilterCache::apply(const FilterOperation &operation, const QImage &image)
+{
+    return lookup(operation.key(), image, [&]()
+                  { return operation.apply(image); });
+}
+
+QImage FilterCache::apply(const QVector<FilterOperation> &chain, const QImage &image)
+{
+    QStringList keys;
+    for (const FilterOperation &operation : chain)
+        keys.append(operation.key());
+    return lookup(keys.join(','), image, [&]()
+                  { return FilterPipeline(chain).apply(image); });
+}
+
+void FilterCache::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    budget = bytes;
+    evict();
+}
+
+qint64 FilterCache::memoryBudget() const
+{
+    QMutexLocker locker(&mutex);
+    return budget;
+}
+
+FilterCache::Statistics FilterCache::statistics() const
+{
+    QMutexLocker locker(&mutex);
+    Statistics statistics;
+    statistics.hits = hits;
+    statistics.misses = misses;
+    statistics.entries = entries.size();
+    statistics.bytes = entryBytes;
+    return statistics;
+}
+
+void FilterCache::clear()
+{
+    QMutexLocker locker(&mutex);
+    entries.clear();
+    entryBytes = 0;
+    fingerprints.clear();
+}
+
+quint64 FilterCache::fingerprint(const QImage &image)
+{
+    const int header[3] = {image.width(), image.height(), int(image.format())};
+    size_t hash = qHashBits(header, sizeof(header));
+    // Only the pixels of each line: the padding after them is undefined.
+    const size_t lineBytes = (size_t(image.width()) * image.depth() + 7) / 8;
+    for (int y = 0; y < image.height(); ++y)
+        hash = qHashBits(image.constScanLine(y), lineBytes, hash);
+    return hash;
+}
+
+QImage FilterCache::lookup(const QString &operationKey, const QImage &image, const std::function<QImage()> &compute)
+{
+    const QString key = QString::number(imageFingerprint(image), 16) + '/' + operationKey;
+    {
+        QMutexLocker locker(&mutex);
+        auto it = entries.find(key);
+        if (it != entries.end())
+        {
+            ++hits;
+            it->lastUse = ++useCounter;
+            return it->image;
+        }
+        ++misses;
+    }
+
+    const QImage result = compute();
+
+    QMutexLocker locker(&mutex);
+    if (result.sizeInBytes() <= budget && !entries.contains(key))
+    {
+        entries.insert(key, Entry{result, ++useCounter});
+        entryBytes += result.sizeInBytes();
+        evict();
+    }
+    return result;
+}
+
+quint64 FilterCache::imageFingerprint(const QImage &image)
+{
+    const qint64 cacheKey = image.cacheKey();
+    {
+        QMutexLocker locker(&mutex);
+        auto it = fingerprints.find(cacheKey);
+        if (it != fingerprints.end())
+            return *it;
+    }
+
+    const quint64 hash = fingerprint(image);
+    QMutexLocker locker(&mutex);
+    if (fingerprints.size() >= MAX_FINGERPRINTS)
+        fingerprints.clear();
+    fingerprints.insert(cacheKey, hash);
+    return hash;
+}
+
+// Called with the mutex held.
+void FilterCache::evict()
+{
+    while (entryBytes > budget && !entries.isEmpty())
+    {
+        auto oldest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->lastUse < oldest->lastUse)
+                oldest = it;
+        }
+        entryBytes -= oldest->image.sizeInBytes();
+        entries.erase(oldest);
+    }
+}
@@ -1,4 +1,5 @@
 #include "filtereditordialog.h"
+#include "filterconstants.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QFile>
@@ -17,6 +18,9 @@ FilterEditorDialog::FilterEditorDialog(QWidget *parent) : QDialog(parent)
     kernelTable = new QTableWidget(3, 3, this);
     kernelTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
     kernelTable->verticalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    // Large kernels scroll instead of squeezing their cells out of sight.
+    kernelTable->horizontalHeader()->setMinimumSectionSize(40);
+    kernelTable->verticalHeader()->setMinimumSectionSize(24);
     kernelTable->setStyleSheet("QTableWidget { gridline-color: gray; }");
 
     for (int r = 0; r < kernelTable->rowCount(); ++r)
@@ -29,8 +33,8 @@ FilterEditorDialog::FilterEditorDialog(QWidget *parent) : QDialog(parent)
 
     rowsSpinBox = new QSpinBox(this);
     colsSpinBox = new QSpinBox(this);
-    rowsSpinBox->setRange(1, 9);
-    colsSpinBox->setRange(1, 9);
+    rowsSpinBox->setRange(1, KERNEL_EDITOR_MAX_SIZE);
+    colsSpinBox->setRange(1, KERNEL_EDITOR_MAX_SIZE);
     rowsSpinBox->setSingleStep(2);
     colsSpinBox->setSingleStep(2);
     rowsSpinBox->setValue(3);
@@ -47,13 +51,25 @@ FilterEditorDialog::FilterEditorDialog(QWidget *parent) : QDialog(parent)
     offsetEdit->setFixedWidth(80);
     anchorRowSpinBox = new QSpinBox(this);
     anchorColSpinBox = new QSpinBox(this);
-    anchorRowSpinBox->setRange(0, 8);
-    anchorColSpinBox->setRange(0, 8);
+    anchorRowSpinBox->setRange(0, rowsSpinBox->value() - 1);
+    anchorColSpinBox->setRange(0, colsSpinBox->value() - 1);
     anchorRowSpinBox->setValue(1);
     anchorColSpinBox->setValue(1);
     anchorRowSpinBox->setFixedWidth(50);
     anchorColSpinBox->setFixedWidth(50);
 
+    // Item data is the Border::Mode; the value is the constant's grey level.
+    borderComboBox = new QComboBox(this);
+    borderComboBox->addItem("Clamp", static_cast<int>(Border::Mode::Clamp));
+    borderComboBox->addItem("Mirror", static_cast<int>(Border::Mode::Mirror));
+    borderComboBox->addItem("Wrap", static_cast<int>(Border::Mode::Wrap));
+    borderComboBox->addItem("Constant", static_cast<int>(Border::Mode::Constant));
+    borderValueSpinBox = new QSpinBox(this);
+    borderValueSpinBox->setRange(0, 255);
+    borderValueSpinBox->setFixedWidth(50);
+    borderValueSpinBox->setEnabled(false);
+    connect(borderComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &FilterEditorDialog::updateBorderValue);
+
     QPushButton *computeDivisorButton = new QPushButton("Compute", this);
     QPushButton *saveFilterButton = new QPushButton("Save", this);
     QPushButton *saveAsFiterButton = new QPushButton("Save As", this);
@@ -94,6 +110,11 @@ FilterEditorDialog::FilterEditorDialog(QWidget *parent) : QDialog(parent)
     filterSettingsLayout->addWidget(new QLabel("Col:"), 2, 3);
     filterSettingsLayout->addWidget(anchorColSpinBox, 2, 4);
 
+    filterSettingsLayout->addWidget(new QLabel("Border:"), 3, 0);
+    filterSettingsLayout->addWidget(borderComboBox, 3, 1);
+    filterSettingsLayout->addWidget(new QLabel("Value:"), 3, 3);
+    filterSettingsLayout->addWidget(borderValueSpinBox, 3, 4);
+
     buttonsLayout->addWidget(loadFilterButton);
     buttonsLayout->addWidget(saveFilterButton);
     buttonsLayout->addWidget(saveAsFiterButton);
@@ -120,6 +141,8 @@ void FilterEditorDialog::updateKernelSize()
     int cols = colsSpinBox->value();
     kernelTable->setRowCount(rows);
     kernelTable->setColumnCount(cols);
+    anchorRowSpinBox->setRange(0, rows - 1);
+    anchorColSpinBox->setRange(0, cols - 1);
 
     for (int r = 0; r < rows; ++r)
     {
@@ -133,6 +156,17 @@ void FilterEditorDialog::updateKernelSize()
     }
 }
 
+void FilterEditorDialog::updateBorderValue()
+{
+    borderValueSpinBox->setEnabled(static_cast<Border::Mode>(borderComboBox->currentData().toInt()) == Border::Mode::Constant);
+}
+
+Border FilterEditorDialog::border() const
+{
+    const Border::Mode mode = static_cast<Border::Mode>(borderComboBox->currentData().toInt());
+    return Border(mode, mode == Border::Mode::Constant ? borderValueSpinBox->value() : 0);
+}
+
 void FilterEditorDialog::computeDivisor()
 {
     for (int r = 0; r < kernelTable->rowCount(); ++r)
@@ -182,6 +216,8 @@ void FilterEditorDialog::saveCustomFilter()
     out << (divisorEdit->text().isEmpty() ? "0" : divisorEdit->text()) << "\n";
     out << (offsetEdit->text().isEmpty() ? "0" : offsetEdit->text()) << "\n";
     out << anchorRowSpinBox->value() << " " << anchorColSpinBox->value() << "\n";
+    if (border() != Border())
+        out << border().name() << "\n";
 
     file.close();
 
@@ -216,6 +252,11 @@ void FilterEditorDialog::loadCustomFilter()
     QTextStream in(&file);
     int rows, cols;
     in >> rows >> cols;
+    if (in.status() != QTextStream::Ok || rows < 1 || cols < 1 || rows > KERNEL_EDITOR_MAX_SIZE || cols > KERNEL_EDITOR_MAX_SIZE)
+    {
+        QMessageBox::warning(this, "Error", QString("The editor supports kernels of 1 to %1 rows and columns.").arg(KERNEL_EDITOR_MAX_SIZE));
+        return;
+    }
     rowsSpinBox->setValue(rows);
     colsSpinBox->setValue(cols);
     kernelTable->setRowCount(rows);
@@ -249,6 +290,24 @@ void FilterEditorDialog::loadCustomFilter()
     anchorRowSpinBox->setValue(anchorX);
     anchorColSpinBox->setValue(anchorY);
 
+    Border border;
+    in.skipWhiteSpace();
+    if (!in.atEnd())
+    {
+        QString borderName;
+        in >> borderName;
+        try
+        {
+            border = Border::parse(borderName);
+        }
+        catch (const std::exception &e)
+        {
+            QMessageBox::warning(this, "Error", e.what());
+        }
+    }
+    borderComboBox->setCurrentIndex(borderComboBox->findData(static_cast<int>(border.mode())));
+    borderValueSpinBox->setValue(border.value());
+
     file.close();
 }
 
@@ -262,8 +321,18 @@ void FilterEditorDialog::applyFilter()
             kernel[r][c] = kernelTable->item(r, c) ? kernelTable->item(r, c)->text().toInt() : 0;
         }
     }
-    Kernel customKernel(rowsSpinBox->value(), colsSpinBox->value(), kernel, divisorEdit->text().toInt(), offsetEdit->text().toInt(),
-                        anchorRowSpinBox->value(), anchorColSpinBox->value());
+    Kernel customKernel;
+    try
+    {
+        customKernel = Kernel(rowsSpinBox->value(), colsSpinBox->value(), kernel, divisorEdit->text().toInt(), offsetEdit->text().toInt(),
+                              anchorRowSpinBox->value(), anchorColSpinBox->value());
+        customKernel.setBorder(border());
+    }
+    catch (const std::exception &e)
+    {
+        QMessageBox::warning(this, "Error", e.what());
+        return;
+    }
     emit filterApplied(customKernel);
     accept();
 }
@@ -0,0 +1,138 @@
+#include "filterhistory.h"
+#include "filterpipeline.h"
+#include <stdexcept>
+
+FilterHistory::FilterHistory(qint64 cacheLimit)
+    : cacheLimit(cacheLimit)
+{
+}
+
+void FilterHistory::reset(const QImage &image)
+{
+    original = image;
+    chain.clear();
+    current = 0;
+    snapshots.clear();
+    snapshotBytes = 0;
+}
+
+void FilterHistory::push(const FilterOperation &operation)
+{
+    // The redo states and their snapshots no longer exist.
+    for (auto it = snapshots.begin(); it != snapshots.end();)
+    {
+        if (it.key() > current)
+        {
+            snapshotBytes -= it->image.sizeInBytes();
+            it = snapshots.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    chain.resize(current);
+    chain.append(operation);
+    ++current;
+}
+
+bool FilterHistory::canUndo() const
+{
+    return current > 0;
+}
+
+bool FilterHistory::canRedo() const
+{
+    return current < chain.size();
+}
+
+void FilterHistory::undo()
+{
+    if (canUndo())
+        --current;
+}
+
+void FilterHistory::redo()
+{
+    if (canRedo())
+        ++current;
+}
+
+int FilterHistory::position() const
+{
+    return current;
+}
+
+QVector<FilterOperation> FilterHistory::operations(int from, int to) const
+{
+    return chain.mid(from, to - from);
+}
+
+void FilterHistory::store(int state, const QImage &image)
+{
+    if (state <= 0 || state > chain.size())
+        return;
+    auto it = snapshots.find(state);
+    if (it != snapshots.end())
+    {
+        snapshotBytes -= it->image.sizeInBytes();
+        snapshots.erase(it);
+    }
+    snapshots.insert(state, Snapshot{image, ++useCounter});
+    snapshotBytes += image.sizeInBytes();
+    evict(state);
+}
+
+int FilterHistory::nearestCached(int state) const
+{
+    for (; state > 0; --state)
+    {
+        if (snapshots.contains(state))
+            return state;
+    }
+    return 0;
+}
+
+QImage FilterHistory::cached(int state)
+{
+    if (state == 0)
+        return original;
+    auto it = snapshots.find(state);
+    if (it == snapshots.end())
+        throw std::runtime_error("History state " + std::to_string(state) + " is not cached");
+    it->lastUse = ++useCounter;
+    return it->image;
+}
+
+QImage FilterHistory::imageAt(int state)
+{
+    const int from = nearestCached(state);
+    if (from == state)
+        return cached(state);
+    const QImage image = FilterPipeline(operations(from, state)).apply(cached(from));
+    store(state, image);
+    return image;
+}
+
+qint64 FilterHistory::cacheSize() const
+{
+    return snapshotBytes;
+}
+
+// Drops least recently used snapshots until the cache fits, never the one
+// just stored: a single image larger than the limit is still kept until the
+// next store.
+void FilterHistory::evict(int keepState)
+{
+    while (snapshotBytes > cacheLimit && snapshots.size() > 1)
+    {
+        auto oldest = snapshots.end();
+        for (auto it = snapshots.begin(); it != snapshots.end(); ++it)
+        {
+            if (it.key() != keepState && (oldest == snapshots.end() || it->lastUse < oldest->lastUse))
+                oldest = it;
+        }
+        snapshotBytes -= oldest->image.sizeInBytes();
+        snapshots.erase(oldest);
+    }
+}
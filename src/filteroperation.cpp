@@ -0,0 +1,449 @@
+#include "filteroperation.h"
+#include "filterconstants.h"
+#include "imageprocessor.h"
+#include <QStringList>
+#include <stdexcept>
+
+namespace
+{
+    struct PredefinedKernel
+    {
+        const char *name;
+        QVector<QVector<int>> (*coefficients)();
+        int divisor;
+        int offset;
+        int anchorX;
+        int anchorY;
+    };
+
+    const PredefinedKernel predefinedKernels[] = {
+        {"blur", getBlurKernel, BLUR_DIVISOR, BLUR_OFFSET, BLUR_ANCHOR_X, BLUR_ANCHOR_Y},
+        {"gaussian_blur", getGaussianBlurKernel, GAUSSIAN_BLUR_DIVISOR, GAUSSIAN_BLUR_OFFSET, GAUSSIAN_BLUR_ANCHOR_X, GAUSSIAN_BLUR_ANCHOR_Y},
+        {"sharpen", getSharpenKernel, SHARPEN_DIVISOR, SHARPEN_OFFSET, SHARPEN_ANCHOR_X, SHARPEN_ANCHOR_Y},
+        {"edge_detection", getEdgeDetectionKernel, EDGE_DETECTION_DIVISOR, EDGE_DETECTION_OFFSET, EDGE_DETECTION_ANCHOR_X,
+         EDGE_DETECTION_ANCHOR_Y},
+        {"emboss", getEmbossKernel, EMBOSS_DIVISOR, EMBOSS_OFFSET, EMBOSS_ANCHOR_X, EMBOSS_ANCHOR_Y}};
+
+    const PredefinedKernel *findPredefinedKernel(const QString &name)
+    {
+        for (const PredefinedKernel &predefined : predefinedKernels)
+        {
+            if (name == predefined.name)
+                return &predefined;
+        }
+        return nullptr;
+    }
+
+    int parseInt(const QString &value, const QString &spec)
+    {
+        bool ok = false;
+        const int result = value.toInt(&ok);
+        if (!ok)
+            throw std::runtime_error("Invalid number '" + value.toStdString() + "' in filter '" + spec.toStdString() + "'");
+        return result;
+    }
+
+    void requireArguments(const QStringList &parts, int count, const QString &spec)
+    {
+        if (parts.size() - 1 != count)
+            throw std::runtime_error("Filter '" + spec.toStdString() + "' expects " + std::to_string(count) + " parameter(s)");
+    }
+
+    // Window size for an image scaled by factor, kept odd when size is odd.
+    int scaledWindow(int size, double factor)
+    {
+        if (factor >= 1.0)
+            return size;
+        int scaledSize = qMax(qMin(size, 3), qRound(size * factor));
+        if (size % 2 == 1 && scaledSize % 2 == 0)
+            ++scaledSize;
+        return qMin(scaledSize, size);
+    }
+
+    // Uniform size x size kernel averaging the window around the pixel.
+    Kernel boxKernel(int size)
+    {
+        // Larger windows could overflow the 32-bit channel sums.
+        if (size < 1 || size > 1001)
+            throw std::runtime_error("Box size must be between 1 and 1001");
+        return Kernel(size, size, QVector<QVector<int>>(size, QVector<int>(size, 1)), size * size, 0, size / 2, size / 2);
+    }
+
+    // Removes a trailing border, as in "box:9:mirror" or "median:5:constant:0",
+    // from the parts of a spec and returns it; clamp when there is none.
+    Border takeBorder(QStringList &parts)
+    {
+        static const QStringList modes = {"clamp", "mirror", "wrap", "constant"};
+        for (int i = 1; i < parts.size(); ++i)
+        {
+            if (modes.contains(parts[i]))
+            {
+                const Border border = Border::parse(parts.mid(i).join(':'));
+                parts = parts.mid(0, i);
+                return border;
+            }
+        }
+        return Border();
+    }
+
+    // Threshold maps are built by doubling the 2x2 or 3x3 base map.
+    bool isThresholdMapSize(int size)
+    {
+        while (size > 3 && size % 2 == 0)
+            size /= 2;
+        return size == 2 || size == 3;
+    }
+}
+
+FilterOperation::FilterOperation()
+    : operationType(Type::Invert)
+{
+}
+
+FilterOperation::FilterOperation(Type type, const QVector<int> &parameters)
+    : operationType(type), parameters(parameters)
+{
+}
+
+FilterOperation FilterOperation::invert()
+{
+    return FilterOperation(Type::Invert, {});
+}
+
+FilterOperation FilterOperation::brightness()
+{
+    return FilterOperation(Type::Brightness, {});
+}
+
+FilterOperation FilterOperation::contrast()
+{
+    return FilterOperation(Type::Contrast, {});
+}
+
+FilterOperation FilterOperation::gamma()
+{
+    return FilterOperation(Type::Gamma, {});
+}
+
+FilterOperation FilterOperation::greyscale()
+{
+    return FilterOperation(Type::Greyscale, {});
+}
+
+FilterOperation FilterOperation::convolution(const Kernel &kernel, const QString &name)
+{
+    FilterOperation operation(Type::Convolution, {});
+    operation.kernel = kernel;
+    operation.kernelName = name;
+    return operation;
+}
+
+FilterOperation FilterOperation::median(int kernelSize, const Border &border)
+{
+    // Larger windows could overflow the 32-bit median index and the size of
+    // the padded planes, as for box kernels.
+    if (kernelSize < 1 || kernelSize > 1001)
+        throw std::runtime_error("Median kernel size must be between 1 and 1001");
+    FilterOperation operation(Type::Median, {kernelSize});
+    operation.medianBorder = border;
+    return operation;
+}
+
+FilterOperation FilterOperation::orderedDithering(int thresholdMapSize, int levels)
+{
+    if (!isThresholdMapSize(thresholdMapSize))
+        throw std::runtime_error("Threshold map size must be 2, 3 or one of them doubled (4, 6, 8, ...)");
+    if (levels < 2 || levels > 256)
+        throw std::runtime_error("Dithering needs between 2 and 256 levels");
+    return FilterOperation(Type::OrderedDithering, {thresholdMapSize, levels});
+}
+
+FilterOperation FilterOperation::uniformQuantization(int rLevels, int gLevels, int bLevels)
+{
+    for (int levels : {rLevels, gLevels, bLevels})
+    {
+        if (levels < 2 || levels > 256)
+            throw std::runtime_error("Quantization needs between 2 and 256 levels per channel");
+    }
+    return FilterOperation(Type::UniformQuantization, {rLevels, gLevels, bLevels});
+}
+
+Kernel FilterOperation::predefinedKernel(const QString &name)
+{
+    const PredefinedKernel *predefined = findPredefinedKernel(name);
+    if (!predefined)
+        throw std::runtime_error("Unknown predefined filter '" + name.toStdString() + "'");
+    try
+    {
+        return Kernel(PREDEFINED_FILTERS_DIR + name + ".flt");
+    }
+    catch (const std::exception &)
+    {
+        const QVector<QVector<int>> coefficients = predefined->coefficients();
+        return Kernel(coefficients.size(), coefficients[0].size(), coefficients, predefined->divisor, predefined->offset,
+                      predefined->anchorX, predefined->anchorY);
+    }
+}
+
+FilterOperation FilterOperation::parse(const QString &spec)
+{
+    const QString trimmed = spec.trimmed();
+    const QString name = trimmed.section(':', 0, 0);
+
+    // Everything after "kernel:" is the path, which may itself contain ':'.
+    if (name == "kernel")
+    {
+        const QString path = trimmed.section(':', 1);
+        if (path.isEmpty())
+            throw std::runtime_error("Filter 'kernel' expects a .flt file path");
+        return convolution(Kernel(path), trimmed);
+    }
+
+    QStringList parts = trimmed.split(':');
+    if (name == "invert" || name == "brightness" || name == "contrast" || name == "gamma" || name == "greyscale")
+    {
+        requireArguments(parts, 0, trimmed);
+        if (name == "invert")
+            return invert();
+        if (name == "brightness")
+            return brightness();
+        if (name == "contrast")
+            return contrast();
+        if (name == "gamma")
+            return gamma();
+        return greyscale();
+    }
+    if (findPredefinedKernel(name) || name == "box")
+    {
+        const Border border = takeBorder(parts);
+        requireArguments(parts, name == "box" ? 1 : 0, trimmed);
+        Kernel kernel = name == "box" ? boxKernel(parseInt(parts[1], trimmed)) : predefinedKernel(name);
+        kernel.setBorder(border);
+        return convolution(kernel, trimmed);
+    }
+    if (name == "median")
+    {
+        const Border border = takeBorder(parts);
+        requireArguments(parts, 1, trimmed);
+        return median(parseInt(parts[1], trimmed), border);
+    }
+    if (name == "dither")
+    {
+        requireArguments(parts, 2, trimmed);
+        return orderedDithering(parseInt(parts[1], trimmed), parseInt(parts[2], trimmed));
+    }
+    if (name == "quantize")
+    {
+        requireArguments(parts, 3, trimmed);
+        return uniformQuantization(parseInt(parts[1], trimmed), parseInt(parts[2], trimmed), parseInt(parts[3], trimmed));
+    }
+    throw std::runtime_error("Unknown filter '" + trimmed.toStdString() + "'");
+}
+
+QVector<FilterOperation> FilterOperation::parseChain(const QString &chain)
+{
+    QVector<FilterOperation> operations;
+    for (const QString &spec : chain.split(',', Qt::SkipEmptyParts))
+        operations.append(parse(spec));
+    if (operations.isEmpty())
+        throw std::runtime_error("Filter chain is empty");
+    return operations;
+}
+
+FilterOperation::Type FilterOperation::type() const
+{
+    return operationType;
+}
+
+QString FilterOperation::toString() const
+{
+    switch (operationType)
+    {
+    case Type::Invert:
+        return "invert";
+    case Type::Brightness:
+        return "brightness";
+    case Type::Contrast:
+        return "contrast";
+    case Type::Gamma:
+        return "gamma";
+    case Type::Greyscale:
+        return "greyscale";
+    case Type::Convolution:
+        return kernelName;
+    case Type::Median:
+        if (medianBorder != Border())
+            return QString("median:%1:").arg(parameters[0]) + medianBorder.name();
+        return QString("median:%1").arg(parameters[0]);
+    case Type::OrderedDithering:
+        return QString("dither:%1:%2").arg(parameters[0]).arg(parameters[1]);
+    case Type::UniformQuantization:
+        return QString("quantize:%1:%2:%3").arg(parameters[0]).arg(parameters[1]).arg(parameters[2]);
+    }
+    return QString();
+}
+
+QString FilterOperation::key() const
+{
+    if (operationType != Type::Convolution)
+        return toString();
+    QStringList parts = {"convolution",
+                         QString::number(kernel.getRows()),
+                         QString::number(kernel.getCols()),
+                         QString::number(kernel.getDivisor()),
+                         QString::number(kernel.getOffset()),
+                         QString::number(kernel.getAnchorX()),
+                         QString::number(kernel.getAnchorY()),
+                         kernel.getBorder().name()};
+    for (int i = 0; i < kernel.getRows() * kernel.getCols(); ++i)
+        parts.append(QString::number(kernel.data()[i]));
+    return parts.join(':');
+}
+
+QImage FilterOperation::apply(const QImage &image) const
+{
+    switch (operationType)
+    {
+    case Type::Invert:
+        return ImageProcessor::invertColors(image);
+    case Type::Brightness:
+        return ImageProcessor::adjustBrightness(image);
+    case Type::Contrast:
+        return ImageProcessor::adjustContrast(image);
+    case Type::Gamma:
+        return ImageProcessor::gammaCorrection(image);
+    case Type::Greyscale:
+        return ImageProcessor::applyGreyscaleFilter(image);
+    case Type::Convolution:
+        return ImageProcessor::applyConvolution(image, kernel);
+    case Type::Median:
+        return ImageProcessor::applyMedianFilter(image, parameters[0], medianBorder);
+    case Type::OrderedDithering:
+        return ImageProcessor::applyOrderedDithering(image, parameters[0], parameters[1]);
+    case Type::UniformQuantization:
+        return ImageProcessor::applyUniformQuantization(image, parameters[0], parameters[1], parameters[2]);
+    }
+    return image;
+}
+
+QImage FilterOperation::apply(QImage &&image) const
+{
+    if (isPointOperation())
+        return ImageProcessor::applyLookupTable(std::move(image), lookupTable());
+    if (operationType == Type::Convolution)
+        return ImageProcessor::applyConvolution(std::move(image), kernel);
+    if (operationType == Type::Median)
+        return ImageProcessor::applyMedianFilter(std::move(image), parameters[0], medianBorder);
+    return apply(static_cast<const QImage &>(image));
+}
+
+QImage FilterOperation::apply(const QImage &image, const QRect &region) const
+{
+    if (isPointOperation())
+        return ImageProcessor::applyLookupTable(image, lookupTable(), region);
+    switch (operationType)
+    {
+    case Type::Greyscale:
+        return ImageProcessor::applyGreyscaleFilter(image, region);
+    case Type::Convolution:
+        return ImageProcessor::applyConvolution(image, kernel, region);
+    case Type::Median:
+        return ImageProcessor::applyMedianFilter(image, parameters[0], region, medianBorder);
+    case Type::OrderedDithering:
+        return ImageProcessor::applyOrderedDithering(image, parameters[0], parameters[1], region);
+    default:
+        return image;
+    }
+}
+
+bool FilterOperation::isPointOperation() const
+{
+    switch (operationType)
+    {
+    case Type::Invert:
+    case Type::Brightness:
+    case Type::Contrast:
+    case Type::Gamma:
+    case Type::UniformQuantization:
+        return true;
+    default:
+        return false;
+    }
+}
+
+LookupTable FilterOperation::lookupTable() const
+{
+    switch (operationType)
+    {
+    case Type::Invert:
+        return ImageProcessor::invertTable();
+    case Type::Brightness:
+        return ImageProcessor::brightnessTable();
+    case Type::Contrast:
+        return ImageProcessor::contrastTable();
+    case Type::Gamma:
+        return ImageProcessor::gammaTable();
+    case Type::UniformQuantization:
+        return ImageProcessor::uniformQuantizationTable(parameters[0], parameters[1], parameters[2]);
+    default:
+        throw std::runtime_error("Filter '" + toString().toStdString() + "' is not a point operation");
+    }
+}
+
+const Kernel &FilterOperation::convolutionKernel() const
+{
+    return kernel;
+}
+
+Border FilterOperation::border() const
+{
+    if (operationType == Type::Convolution)
+        return kernel.getBorder();
+    if (operationType == Type::Median)
+        return medianBorder;
+    return Border();
+}
+
+QMargins FilterOperation::margins() const
+{
+    if (operationType == Type::Convolution)
+        return QMargins(kernel.getAnchorY(), kernel.getAnchorX(), kernel.getCols() - 1 - kernel.getAnchorY(),
+                        kernel.getRows() - 1 - kernel.getAnchorX());
+    if (operationType == Type::Median)
+    {
+        const int half = parameters[0] / 2;
+        return QMargins(half, half, half, half);
+    }
+    return QMargins();
+}
+
+int FilterOperation::period() const
+{
+    return operationType == Type::OrderedDithering ? parameters[0] : 1;
+}
+
+FilterOperation FilterOperation::scaled(double factor) const
+{
+    FilterOperation operation = *this;
+    if (operationType == Type::Convolution)
+        operation.kernel = kernel.resampled(scaledWindow(kernel.getRows(), factor), scaledWindow(kernel.getCols(), factor));
+    else if (operationType == Type::Median)
+        operation.parameters[0] = scaledWindow(parameters[0], factor);
+    return operation;
+}
+
+QImage FilterOperation::applyChain(const QImage &image, const QVector<FilterOperation> &chain)
+{
+    QImage result = image;
+    for (const FilterOperation &operation : chain)
+        result = operation.apply(std::move(result));
+    return result;
+}
+
+QString FilterOperation::chainToString(const QVector<FilterOperation> &chain)
+{
+    QStringList specs;
+    for (const FilterOperation &operation : chain)
+        specs.append(operation.toString());
+    return specs.join(',');
+}
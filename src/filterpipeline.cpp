@@ -0,0 +1,335 @@
+#include "filterpipeline.h"
+#include "imagebufferpool.h"
+#include "imageprocessor.h"
+#include "pixelaccess.h"
+#include "tilescheduler.h"
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    // Target size of one strip of rows, small enough for every stage's
+    // buffer of a strip to stay in the L2 cache together.
+    const int STRIP_BYTES = 256 * 1024;
+
+    int haloAbove(const Kernel &kernel)
+    {
+        return kernel.getAnchorX();
+    }
+
+    int haloBelow(const Kernel &kernel)
+    {
+        return kernel.getRows() - 1 - kernel.getAnchorX();
+    }
+
+    // Row buffer holding rows [firstRow, lastRow) of an intermediate image.
+    struct StripBuffer
+    {
+        ImageBufferPool::Scratch<QRgb> pixels;
+        int firstRow = 0;
+        int width = 0;
+
+        void reset(int first, int last, int rowWidth)
+        {
+            firstRow = first;
+            width = rowWidth;
+            pixels.resize((last - first) * rowWidth);
+        }
+
+        QRgb *row(int y)
+        {
+            return pixels.data() + (y - firstRow) * width;
+        }
+    };
+
+    // Rows [first, topFirst + top.height()) of top followed by bottom, in
+    // top's format, for images of the same width and format.
+    QImage joinRows(const QImage &top, int topFirst, int first, const QImage &bottom)
+    {
+        const int topRows = topFirst + top.height() - first;
+        if (topRows == 0)
+            return bottom;
+        if (bottom.isNull() && topRows == top.height())
+            return top;
+        QImage joined = ImageBufferPool::createImage(QSize(top.width(), topRows + bottom.height()), top.format());
+        const qsizetype rowBytes = qsizetype(top.width()) * top.depth() / 8;
+        for (int y = 0; y < topRows; ++y)
+            std::memcpy(joined.scanLine(y), top.constScanLine(first - topFirst + y), rowBytes);
+        for (int y = 0; y < bottom.height(); ++y)
+            std::memcpy(joined.scanLine(topRows + y), bottom.constScanLine(y), rowBytes);
+        return joined;
+    }
+}
+
+FilterPipeline::FilterPipeline()
+{
+}
+
+FilterPipeline::FilterPipeline(const QVector<FilterOperation> &operations)
+{
+    for (const FilterOperation &operation : operations)
+        append(operation);
+}
+
+void FilterPipeline::append(const FilterOperation &operation)
+{
+    chain.append(operation);
+    Stage *last = stages.isEmpty() ? nullptr : &stages.last();
+
+    if (operation.isPointOperation())
+    {
+        const LookupTable table = operation.lookupTable();
+        if (last && last->kind == Stage::Kind::Lookup)
+            last->table = last->table.then(table);
+        else if (last && last->kind == Stage::Kind::Streamed)
+            last->kernelTables.last() = last->kernelTables.last().then(table);
+        else
+            stages.append(Stage{Stage::Kind::Lookup, table, {}, {}, operation});
+        return;
+    }
+
+    // Strips only see the rows next to them, which is all clamp and constant
+    // borders read; mirror and wrap ones run on the whole image.
+    if (operation.type() == FilterOperation::Type::Convolution && operation.border().isLocal())
+    {
+        // A table in front of the first kernel is applied while its source
+        // rows are read.
+        if (last && last->kind == Stage::Kind::Lookup)
+            last->kind = Stage::Kind::Streamed;
+        else if (!last || last->kind != Stage::Kind::Streamed)
+            stages.append(Stage{Stage::Kind::Streamed, LookupTable(), {}, {}, operation});
+        stages.last().kernels.append(operation.convolutionKernel());
+        stages.last().kernelTables.append(LookupTable());
+        return;
+    }
+
+    stages.append(Stage{Stage::Kind::Operation, LookupTable(), {}, {}, operation});
+}
+
+const QVector<FilterOperation> &FilterPipeline::operations() const
+{
+    return chain;
+}
+
+bool FilterPipeline::isEmpty() const
+{
+    return chain.isEmpty();
+}
+
+int FilterPipeline::passCount() const
+{
+    return stages.size();
+}
+
+QImage FilterPipeline::apply(const QImage &image) const
+{
+    QImage result = image;
+    return apply(std::move(result));
+}
+
+QImage FilterPipeline::apply(QImage &&image) const
+{
+    QImage result = std::move(image);
+    for (const Stage &stage : stages)
+    {
+        switch (stage.kind)
+        {
+        case Stage::Kind::Lookup:
+            result = stage.table.apply(std::move(result));
+            break;
+        case Stage::Kind::Streamed:
+            result = applyStreamed(std::move(result), stage);
+            break;
+        case Stage::Kind::Operation:
+            result = stage.operation.apply(std::move(result));
+            break;
+        }
+    }
+    return result;
+}
+
+QMargins FilterPipeline::margins() const
+{
+    QMargins margins;
+    for (const FilterOperation &operation : chain)
+        margins += operation.margins();
+    return margins;
+}
+
+bool FilterPipeline::isLocal() const
+{
+    for (const FilterOperation &operation : chain)
+    {
+        if (!operation.border().isLocal())
+            return false;
+    }
+    return true;
+}
+
+int FilterPipeline::period() const
+{
+    int period = 1;
+    for (const FilterOperation &operation : chain)
+        period = std::lcm(period, operation.period());
+    return period;
+}
+
+QImage FilterPipeline::applyRegion(const QImage &image, const QRect &region) const
+{
+    const QRect area = region.intersected(image.rect());
+    if (!isLocal())
+        return area.isEmpty() ? QImage() : apply(image).copy(area);
+    const QRect source = ImageProcessor::regionSource(area, margins(), period(), image.size());
+    if (source.isEmpty())
+        return QImage();
+    const QImage result = apply(image.copy(source));
+    return result.copy(area.translated(-source.left(), -source.top()));
+}
+
+QImage FilterPipeline::apply(const QImage &image, const QRect &region) const
+{
+    const QRect area = region.intersected(image.rect());
+    return ImageProcessor::pasteRegion(image, area, applyRegion(image, area), area.topLeft());
+}
+
+// Each strip is filtered as part of a chunk reaching margins().top() rows
+// above it and margins().bottom() below it. Rows of a chunk within that
+// distance of its cut edges see clamped rows instead of their real
+// neighbours, but those are exactly the rows dropped again, so the strip's
+// own rows come out exact.
+// Chunks start on a multiple of every dithering threshold map size so the
+// maps line up with the rows as they would in the whole image.
+void FilterPipeline::applyStrips(int height, int stripRows, const StripReader &read, const StripWriter &write) const
+{
+    if (stripRows < 1)
+        throw std::runtime_error("Strips must have at least one row");
+    if (!isLocal())
+        throw std::runtime_error("Mirror and wrap borders need the whole image and cannot be filtered in strips");
+    const int above = margins().top();
+    const int below = margins().bottom();
+    const int rowPeriod = period();
+
+    // The unfiltered rows [windowFirst, windowFirst + window.height()) read
+    // so far that a later strip may still need.
+    QImage window;
+    int windowFirst = 0;
+    for (int stripFirst = 0; stripFirst < height; stripFirst += stripRows)
+    {
+        const int stripLast = qMin(stripFirst + stripRows, height);
+        const int chunkFirst = qMax(0, stripFirst - above) / rowPeriod * rowPeriod;
+        const int chunkLast = qMin(height, stripLast + below);
+        const int readRows = chunkLast - (windowFirst + window.height());
+
+        QImage fresh;
+        if (readRows > 0)
+        {
+            fresh = read(readRows);
+            if (fresh.height() != readRows || (!window.isNull() && (fresh.width() != window.width() || fresh.format() != window.format())))
+                throw std::runtime_error("Strip read does not continue the image");
+        }
+        window = joinRows(window, windowFirst, chunkFirst, fresh);
+        windowFirst = chunkFirst;
+
+        const QImage result = apply(window);
+        write(result, stripFirst - chunkFirst, stripLast - stripFirst);
+    }
+}
+
+QImage FilterPipeline::applyStreamed(QImage &&image, const Stage &stage)
+{
+    if (!PixelAccess::prepareInPlace(image))
+    {
+        const QImage source = PixelAccess::normalized(image);
+        QImage result = PixelAccess::createResult(source.size());
+        int haloRows = 0;
+        for (const Kernel &kernel : stage.kernels)
+            haloRows += qMax(haloAbove(kernel), haloBelow(kernel));
+        const PixelAccess::RowWriter<QRgb> resultRows = PixelAccess::rows(result);
+        TileScheduler::forEachBand(source.height(), haloRows, [&](int firstRow, int lastRow)
+                                   { streamRows(stage, [&source](int y)
+                                                { return PixelAccess::constRow(source, y); },
+                                                resultRows, source.width(), source.height(), firstRow, lastRow); });
+        return result;
+    }
+
+    int above = 0;
+    int below = 0;
+    for (const Kernel &kernel : stage.kernels)
+    {
+        above += haloAbove(kernel);
+        below += haloBelow(kernel);
+    }
+    const int width = image.width();
+    const int height = image.height();
+    PixelAccess::filterInPlace(image, above, below,
+                               [&](const PixelAccess::ConstRowFunction &sourceRow, const PixelAccess::RowFunction &resultRow, int firstRow,
+                                   int lastRow)
+                               { streamRows(stage, sourceRow, resultRow, width, height, firstRow, lastRow); });
+    return std::move(image);
+}
+
+// Rows [firstRow, lastRow) are cut into strips. For a strip, the rows every
+// kernel has to produce are worked out backwards from the strip (its halo
+// clamped to the image, exactly the rows applyConvolution would read), then
+// the kernels run forwards over per-stage row buffers, the last one writing
+// straight into the result.
+void FilterPipeline::streamRows(const Stage &stage, const PixelAccess::ConstRowFunction &sourceRow, const PixelAccess::RowFunction &resultRow,
+                                int width, int height, int firstRow, int lastRow)
+{
+    const int kernelCount = stage.kernels.size();
+    int haloRows = 0;
+    for (const Kernel &kernel : stage.kernels)
+        haloRows += qMax(haloAbove(kernel), haloBelow(kernel));
+    const int stripRows = qMax(qMax(1, 2 * haloRows), STRIP_BYTES / qMax(1, width * int(sizeof(QRgb))));
+
+    // buffers[0] holds table-mapped source rows, buffers[k] the output of
+    // kernel k - 1.
+    std::vector<StripBuffer> buffers(kernelCount);
+    QVector<int> first(kernelCount + 1);
+    QVector<int> last(kernelCount + 1);
+
+    for (int stripFirst = firstRow; stripFirst < lastRow; stripFirst += stripRows)
+    {
+        first[kernelCount] = stripFirst;
+        last[kernelCount] = qMin(stripFirst + stripRows, lastRow);
+        for (int k = kernelCount - 1; k >= 0; --k)
+        {
+            first[k] = qMax(0, first[k + 1] - haloAbove(stage.kernels[k]));
+            last[k] = qMin(height, last[k + 1] + haloBelow(stage.kernels[k]));
+        }
+
+        PixelAccess::ConstRowFunction input = sourceRow;
+        if (!stage.table.isIdentity())
+        {
+            StripBuffer &mapped = buffers[0];
+            mapped.reset(first[0], last[0], width);
+            for (int y = first[0]; y < last[0]; ++y)
+                stage.table.mapRow(sourceRow(y), mapped.row(y), width);
+            input = [&mapped](int y)
+            { return mapped.row(y); };
+        }
+
+        for (int k = 0; k < kernelCount; ++k)
+        {
+            PixelAccess::RowFunction output = resultRow;
+            if (k + 1 < kernelCount)
+            {
+                StripBuffer &buffer = buffers[k + 1];
+                buffer.reset(first[k + 1], last[k + 1], width);
+                output = [&buffer](int y)
+                { return buffer.row(y); };
+            }
+            ImageProcessor::convolveRows(input, output, width, height, stage.kernels[k], first[k + 1], last[k + 1]);
+
+            const LookupTable &table = stage.kernelTables[k];
+            if (!table.isIdentity())
+            {
+                for (int y = first[k + 1]; y < last[k + 1]; ++y)
+                    table.mapRow(output(y), output(y), width);
+            }
+            input = output;
+        }
+    }
+}
@@ -0,0 +1,189 @@
+#include "imagebufferpool.h"
+#include "filterconstants.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <map>
+#include <new>
+
+namespace
+{
+    // Buffer sizes are rounded up to whole pages, and an idle buffer is
+    // reused for requests it exceeds by at most a quarter, so buffers for
+    // similar sizes are shared without wasting much of them.
+    const qsizetype PAGE_BYTES = 4096;
+
+    struct IdleBuffer
+    {
+        uchar *data;
+        quint64 releasedAt;
+    };
+
+    struct PoolState
+    {
+        QMutex mutex;
+        qint64 limit = BUFFER_POOL_LIMIT;
+        std::multimap<qsizetype, IdleBuffer> idle;
+        quint64 releaseCounter = 0;
+        ImageBufferPool::Statistics statistics;
+    };
+
+    // Never destroyed: images may release their buffers during static
+    // destruction.
+    PoolState &state()
+    {
+        static PoolState *pool = new PoolState;
+        return *pool;
+    }
+
+    uchar *allocate(qsizetype bytes)
+    {
+        return static_cast<uchar *>(::operator new[](bytes, std::align_val_t(ImageBufferPool::ALIGNMENT)));
+    }
+
+    void deallocate(uchar *data)
+    {
+        ::operator delete[](data, std::align_val_t(ImageBufferPool::ALIGNMENT));
+    }
+
+    void notePeak(ImageBufferPool::Statistics &statistics)
+    {
+        statistics.peakBytes = qMax(statistics.peakBytes, statistics.bytesInUse + statistics.idleBytes);
+    }
+
+    // Frees the least recently released idle buffers until bytes fit under
+    // the limit. Called with the mutex held.
+    void trimIdle(PoolState &pool, qint64 bytes)
+    {
+        while (!pool.idle.empty() && pool.statistics.idleBytes + bytes > pool.limit)
+        {
+            auto oldest = pool.idle.begin();
+            for (auto it = pool.idle.begin(); it != pool.idle.end(); ++it)
+            {
+                if (it->second.releasedAt < oldest->second.releasedAt)
+                    oldest = it;
+            }
+            pool.statistics.idleBytes -= oldest->first;
+            deallocate(oldest->second.data);
+            pool.idle.erase(oldest);
+        }
+    }
+
+    int bytesPerPixel(QImage::Format format)
+    {
+        switch (format)
+        {
+        case QImage::Format_Grayscale8:
+            return 1;
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+        case QImage::Format_ARGB32_Premultiplied:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    void releaseImageBuffer(void *info)
+    {
+        ImageBufferPool::Block *block = static_cast<ImageBufferPool::Block *>(info);
+        ImageBufferPool::release(*block);
+        delete block;
+    }
+}
+
+ImageBufferPool::Block ImageBufferPool::acquire(qsizetype bytes)
+{
+    if (bytes <= 0)
+        return Block();
+    const qsizetype capacity = (bytes + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES;
+
+    PoolState &pool = state();
+    QMutexLocker locker(&pool.mutex);
+    ++pool.statistics.requests;
+    auto fit = pool.idle.lower_bound(capacity);
+    if (fit != pool.idle.end() && fit->first <= capacity + capacity / 4)
+    {
+        const Block block{fit->second.data, fit->first};
+        pool.idle.erase(fit);
+        ++pool.statistics.reused;
+        pool.statistics.idleBytes -= block.capacity;
+        pool.statistics.bytesInUse += block.capacity;
+        return block;
+    }
+
+    pool.statistics.bytesInUse += capacity;
+    notePeak(pool.statistics);
+    locker.unlock();
+    return Block{allocate(capacity), capacity};
+}
+
+void ImageBufferPool::release(const Block &block)
+{
+    if (!block.data)
+        return;
+
+    PoolState &pool = state();
+    QMutexLocker locker(&pool.mutex);
+    pool.statistics.bytesInUse -= block.capacity;
+    if (block.capacity > pool.limit)
+    {
+        locker.unlock();
+        deallocate(block.data);
+        return;
+    }
+    trimIdle(pool, block.capacity);
+    pool.idle.emplace(block.capacity, IdleBuffer{block.data, ++pool.releaseCounter});
+    pool.statistics.idleBytes += block.capacity;
+}
+
+QImage ImageBufferPool::createImage(const QSize &size, QImage::Format format)
+{
+    const int pixelBytes = bytesPerPixel(format);
+    if (size.isEmpty() || pixelBytes == 0)
+        return QImage(size, format);
+    // The scan line length QImage itself would use, padded to 32 bits.
+    const qsizetype bytesPerLine = (qsizetype(size.width()) * pixelBytes + 3) / 4 * 4;
+    Block *block = new Block(acquire(bytesPerLine * size.height()));
+    return QImage(block->data, size.width(), size.height(), bytesPerLine, format, releaseImageBuffer, block);
+}
+
+void ImageBufferPool::setLimit(qint64 bytes)
+{
+    PoolState &pool = state();
+    QMutexLocker locker(&pool.mutex);
+    pool.limit = qMax(bytes, qint64(0));
+    trimIdle(pool, 0);
+}
+
+qint64 ImageBufferPool::limit()
+{
+    PoolState &pool = state();
+    QMutexLocker locker(&pool.mutex);
+    return pool.limit;
+}
+
+ImageBufferPool::Statistics ImageBufferPool::statistics()
+{
+    PoolState &pool = state();
+    QMutexLocker locker(&pool.mutex);
+    return pool.statistics;
+}
+
+void ImageBufferPool::resetStatistics()
+{
+    PoolState &pool = state();
+    QMutexLocker locker(&pool.mutex);
+    pool.statistics.requests = 0;
+    pool.statistics.reused = 0;
+    pool.statistics.peakBytes = pool.statistics.bytesInUse + pool.statistics.idleBytes;
+}
+
+void ImageBufferPool::clear()
+{
+    PoolState &pool = state();
+    QMutexLocker locker(&pool.mutex);
+    for (const auto &entry : pool.idle)
+        deallocate(entry.second.data);
+    pool.idle.clear();
+    pool.statistics.idleBytes = 0;
+}
@@ -1,411 +1,1060 @@
 #include "imageprocessor.h"
 #include "filterconstants.h"
+#include "pixelaccess.h"
+#include "convolutionkernels.h"
+#include "imagebufferpool.h"
+#include "medianfilter.h"
+#include "tilescheduler.h"
+#include "fft.h"
 #include <QtMath>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <QtGui/QImage>
 #include <QtGui/QColor>
 
-QImage ImageProcessor::invertColors(const QImage &image)
+void ImageProcessor::setThreadCount(int count)
+{
+    TileScheduler::setThreadCount(count);
+}
+
+int ImageProcessor::threadCount()
 {
-    QImage result = image;
-    for (int y = 0; y < image.height(); ++y)
+    return TileScheduler::threadCount();
+}
+
+static std::atomic<int> &fftMinimumTaps()
+{
+    static std::atomic<int> taps(FFT_CONVOLUTION_MIN_TAPS);
+    return taps;
+}
+
+void ImageProcessor::setFftThreshold(int taps)
+{
+    fftMinimumTaps().store(qMax(0, taps));
+}
+
+int ImageProcessor::fftThreshold()
+{
+    return fftMinimumTaps().load();
+}
+
+LookupTable ImageProcessor::invertTable()
+{
+    return LookupTable([](int value)
+                       { return 255 - value; });
+}
+
+LookupTable ImageProcessor::brightnessTable()
+{
+    int brightness = BRIGHTNESS_ADJUSTMENT;
+    return LookupTable([brightness](int value)
+                       { return qBound(0, value + brightness, 255); });
+}
+
+LookupTable ImageProcessor::contrastTable()
+{
+    double contrast = CONTRAST_ADJUSTMENT;
+    double factor = (259 * (contrast + 255)) / (255 * (259 - contrast));
+    return LookupTable([factor](int value)
+                       { return qBound(0, static_cast<int>(factor * (value - 128) + 128), 255); });
+}
+
+LookupTable ImageProcessor::gammaTable()
+{
+    double gamma = GAMMA_CORRECTION;
+    return LookupTable([gamma](int value)
+                       { return qBound(0, static_cast<int>(255 * pow(value / 255.0, gamma)), 255); });
+}
+
+LookupTable ImageProcessor::uniformQuantizationTable(int rLevels, int gLevels, int bLevels)
+{
+    auto quantize = [](int levels)
     {
-        for (int x = 0; x < image.width(); ++x)
+        return [levels](int value) -> int
         {
-            QColor color = image.pixelColor(x, y);
-            color.setRgb(255 - color.red(), 255 - color.green(), 255 - color.blue());
-            result.setPixelColor(x, y, color);
-        }
-    }
+            if (levels <= 1)
+                return 0;
+            int quant = (value * (levels - 1)) / 255;
+            return (quant * 255) / (levels - 1);
+        };
+    };
+    return LookupTable(quantize(rLevels), quantize(gLevels), quantize(bLevels));
+}
+
+QImage ImageProcessor::applyLookupTable(const QImage &image, const LookupTable &table)
+{
+    return table.apply(image);
+}
+
+PlanarImage ImageProcessor::applyLookupTable(const PlanarImage &image, const LookupTable &table)
+{
+    PlanarImage result(image.size());
+    TileScheduler::forEachBand(image.height(), 0, [&](int firstRow, int lastRow)
+                               {
+        for (int y = firstRow; y < lastRow; ++y)
+        {
+            for (int channel = 0; channel < PlanarImage::CHANNELS; ++channel)
+                table.mapChannelRow(channel, image.constRow(channel, y), result.row(channel, y), image.width());
+        } });
     return result;
 }
 
+QImage ImageProcessor::invertColors(const QImage &image)
+{
+    return applyLookupTable(image, invertTable());
+}
+
 QImage ImageProcessor::adjustBrightness(const QImage &image)
 {
-    int brightness = BRIGHTNESS_ADJUSTMENT;
-    QImage result = image;
-    for (int y = 0; y < image.height(); ++y)
+    return applyLookupTable(image, brightnessTable());
+}
+
+QImage ImageProcessor::adjustContrast(const QImage &image)
+{
+    return applyLookupTable(image, contrastTable());
+}
+
+QImage ImageProcessor::gammaCorrection(const QImage &image)
+{
+    return applyLookupTable(image, gammaTable());
+}
+
+QImage ImageProcessor::applyLookupTable(QImage &&image, const LookupTable &table)
+{
+    return table.apply(std::move(image));
+}
+
+QImage ImageProcessor::invertColors(QImage &&image)
+{
+    return applyLookupTable(std::move(image), invertTable());
+}
+
+QImage ImageProcessor::adjustBrightness(QImage &&image)
+{
+    return applyLookupTable(std::move(image), brightnessTable());
+}
+
+QImage ImageProcessor::adjustContrast(QImage &&image)
+{
+    return applyLookupTable(std::move(image), contrastTable());
+}
+
+QImage ImageProcessor::gammaCorrection(QImage &&image)
+{
+    return applyLookupTable(std::move(image), gammaTable());
+}
+
+// Where the convolution passes read and write their rows, so packed and
+// planar images share them: loadRow fills the padded red, green and blue
+// planes of source row y, storeRow rounds the three sum rows of result row y
+// into it. Rows above and below the image and the padding are resolved
+// through the kernel's border there, once per row, so the passes index
+// their planes without any bounds checks.
+struct ConvolutionRows
+{
+    std::function<void(int y, int padLeft, int paddedWidth, uchar *red, uchar *green, uchar *blue)> loadRow;
+    std::function<void(int y, const int *red, const int *green, const int *blue)> storeRow;
+};
+
+static ConvolutionRows packedRows(const ImageProcessor::ConstRowFunction &sourceRow, const ImageProcessor::RowFunction &resultRow,
+                                  int width, int height, const Kernel &kernel)
+{
+    const double factor = kernel.getFactor();
+    const int bias = kernel.getOffset();
+    const Border border = kernel.getBorder();
+    return {[&sourceRow, width, height, border](int y, int padLeft, int paddedWidth, uchar *red, uchar *green, uchar *blue)
+            {
+                const int row = border.map(y, height);
+                PixelAccess::splitPaddedRow(row < 0 ? nullptr : sourceRow(row), width, padLeft, paddedWidth, red, green, blue, border);
+            },
+            [&resultRow, width, factor, bias](int y, const int *red, const int *green, const int *blue)
+            { ConvolutionKernels::storePixels(resultRow(y), red, green, blue, factor, bias, width); }};
+}
+
+static ConvolutionRows planarRows(const PlanarImage &source, PlanarImage &result, const Kernel &kernel)
+{
+    const double factor = kernel.getFactor();
+    const int bias = kernel.getOffset();
+    const int width = source.width();
+    const int height = source.height();
+    const Border border = kernel.getBorder();
+    return {[&source, width, height, border](int y, int padLeft, int paddedWidth, uchar *red, uchar *green, uchar *blue)
+            {
+                const int row = border.map(y, height);
+                PixelAccess::padRow(row < 0 ? nullptr : source.constRow(0, row), width, padLeft, paddedWidth, red, border);
+                PixelAccess::padRow(row < 0 ? nullptr : source.constRow(1, row), width, padLeft, paddedWidth, green, border);
+                PixelAccess::padRow(row < 0 ? nullptr : source.constRow(2, row), width, padLeft, paddedWidth, blue, border);
+            },
+            [&result, width, factor, bias](int y, const int *red, const int *green, const int *blue)
+            {
+                ConvolutionKernels::storeChannel(result.row(0, y), red, factor, bias, width);
+                ConvolutionKernels::storeChannel(result.row(1, y), green, factor, bias, width);
+                ConvolutionKernels::storeChannel(result.row(2, y), blue, factor, bias, width);
+            }};
+}
+
+// Direct 2D convolution of rows [firstRow, lastRow): every source row the
+// rows need is split once into padded planes, then each tap adds a shifted
+// plane row to the sums, or for 3x3 and 5x5 kernels the window function
+// computes each channel's sums in one pass.
+static void convolveDirect(const ConvolutionRows &rows, int width, const Kernel &kernel, int firstRow, int lastRow)
+{
+    const int offsetRow = kernel.getAnchorX();
+    const int offsetCol = kernel.getAnchorY();
+    const QVector<Kernel::Tap> &taps = kernel.getTaps();
+    const int kernelRows = kernel.getRows();
+    const int kernelCols = kernel.getCols();
+    const int paddedWidth = width + kernelCols - 1;
+
+    const int sourceRows = lastRow - firstRow + kernelRows - 1;
+    ImageBufferPool::Scratch<uchar> planes(sourceRows * 3 * paddedWidth);
+    for (int i = 0; i < sourceRows; ++i)
+    {
+        uchar *red = planes.data() + i * 3 * paddedWidth;
+        rows.loadRow(firstRow - offsetRow + i, offsetCol, paddedWidth, red, red + paddedWidth, red + 2 * paddedWidth);
+    }
+
+    ImageBufferPool::Scratch<int> sums(3 * width);
+    const ConvolutionKernels::WindowFunction window =
+        kernelRows == kernelCols ? ConvolutionKernels::windowFunction(kernelRows, kernel.data()) : nullptr;
+    if (window)
     {
-        for (int x = 0; x < image.width(); ++x)
+        const uchar *windowRows[5];
+        for (int y = firstRow; y < lastRow; ++y)
         {
-            QColor color = image.pixelColor(x, y);
-            color.setRgb(qBound(0, color.red() + brightness, 255),
-                         qBound(0, color.green() + brightness, 255),
-                         qBound(0, color.blue() + brightness, 255));
-            result.setPixelColor(x, y, color);
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                for (int r = 0; r < kernelRows; ++r)
+                    windowRows[r] = planes.constData() + ((y - firstRow + r) * 3 + channel) * paddedWidth;
+                window(sums.data() + channel * width, windowRows, kernel.data(), width);
+            }
+            rows.storeRow(y, sums.constData(), sums.constData() + width, sums.constData() + 2 * width);
         }
+        return;
+    }
+
+    for (int y = firstRow; y < lastRow; ++y)
+    {
+        std::fill(sums.data(), sums.data() + sums.size(), 0);
+        for (const Kernel::Tap &tap : taps)
+        {
+            const uchar *red = planes.constData() + (y - firstRow + tap.row) * 3 * paddedWidth + tap.col;
+            ConvolutionKernels::multiplyAccumulate(sums.data(), red, tap.weight, width);
+            ConvolutionKernels::multiplyAccumulate(sums.data() + width, red + paddedWidth, tap.weight, width);
+            ConvolutionKernels::multiplyAccumulate(sums.data() + 2 * width, red + 2 * paddedWidth, tap.weight, width);
+        }
+        rows.storeRow(y, sums.constData(), sums.constData() + width, sums.constData() + 2 * width);
     }
-    return result;
 }
 
-QImage ImageProcessor::adjustContrast(const QImage &image)
+// Two 1D passes for rank-1 kernels: first every source row the rows need
+// (their own rows plus the vertical halo) is convolved with the horizontal
+// factor into an integer buffer, then those rows are combined with the
+// vertical factor. The integer sums equal the direct 2D sums exactly, so
+// the rounding through divisor and offset is unchanged.
+static void convolveSeparable(const ConvolutionRows &rows, int width, const Kernel &kernel, int firstRow, int lastRow)
 {
-    double contrast = CONTRAST_ADJUSTMENT;
-    QImage result = image;
-    double factor = (259 * (contrast + 255)) / (255 * (259 - contrast));
+    const int offsetRow = kernel.getAnchorX();
+    const int offsetCol = kernel.getAnchorY();
+    const QVector<int> &horizontal = kernel.getHorizontalKernel();
+    const QVector<int> &vertical = kernel.getVerticalKernel();
+    const int kernelRows = vertical.size();
+    const int kernelCols = horizontal.size();
+    const int paddedWidth = width + kernelCols - 1;
+    const int rowValues = width * 3;
 
-    for (int y = 0; y < image.height(); ++y)
+    const int passRows = lastRow - firstRow + kernelRows - 1;
+    ImageBufferPool::Scratch<int> horizontalSums(passRows * rowValues);
+    std::fill(horizontalSums.data(), horizontalSums.data() + horizontalSums.size(), 0);
+    ImageBufferPool::Scratch<uchar> planes(3 * paddedWidth);
+    for (int i = 0; i < passRows; ++i)
     {
-        for (int x = 0; x < image.width(); ++x)
+        rows.loadRow(firstRow - offsetRow + i, offsetCol, paddedWidth, planes.data(), planes.data() + paddedWidth,
+                     planes.data() + 2 * paddedWidth);
+        int *sums = horizontalSums.data() + i * rowValues;
+        for (int kx = 0; kx < kernelCols; ++kx)
         {
-            QColor color = image.pixelColor(x, y);
-            color.setRgb(qBound(0, static_cast<int>(factor * (color.red() - 128) + 128), 255),
-                         qBound(0, static_cast<int>(factor * (color.green() - 128) + 128), 255),
-                         qBound(0, static_cast<int>(factor * (color.blue() - 128) + 128), 255));
-            result.setPixelColor(x, y, color);
+            const int weight = horizontal[kx];
+            if (weight == 0)
+                continue;
+            for (int channel = 0; channel < 3; ++channel)
+                ConvolutionKernels::multiplyAccumulate(sums + channel * width, planes.constData() + channel * paddedWidth + kx, weight, width);
         }
     }
-    return result;
-}
 
-QImage ImageProcessor::gammaCorrection(const QImage &image)
-{
-    double gamma = GAMMA_CORRECTION;
-    QImage result = image;
-    for (int y = 0; y < image.height(); ++y)
+    ImageBufferPool::Scratch<int> totals(rowValues);
+    for (int y = firstRow; y < lastRow; ++y)
     {
-        for (int x = 0; x < image.width(); ++x)
+        std::fill(totals.data(), totals.data() + totals.size(), 0);
+        for (int ky = 0; ky < kernelRows; ++ky)
         {
-            QColor color = image.pixelColor(x, y);
-            color.setRgb(qBound(0, static_cast<int>(255 * pow(color.red() / 255.0, gamma)), 255),
-                         qBound(0, static_cast<int>(255 * pow(color.green() / 255.0, gamma)), 255),
-                         qBound(0, static_cast<int>(255 * pow(color.blue() / 255.0, gamma)), 255));
-            result.setPixelColor(x, y, color);
+            const int weight = vertical[ky];
+            if (weight == 0)
+                continue;
+            ConvolutionKernels::multiplyAccumulate(totals.data(), horizontalSums.constData() + (y - firstRow + ky) * rowValues, weight,
+                                                   rowValues);
         }
+        rows.storeRow(y, totals.constData(), totals.constData() + width, totals.constData() + 2 * width);
     }
-    return result;
 }
 
-QImage ImageProcessor::applyConvolution(const QImage &image, const Kernel &kernel)
+// sums[x] = values[x] + ... + values[x + window - 1] for x in [0, count),
+// each from the previous one by adding the value entering the window and
+// subtracting the one leaving it.
+static void slidingSums(const uchar *values, int window, int count, int *sums)
+{
+    int sum = 0;
+    for (int i = 0; i < window; ++i)
+        sum += values[i];
+    sums[0] = sum;
+    for (int x = 1; x < count; ++x)
+    {
+        sum += values[x + window - 1] - values[x - 1];
+        sums[x] = sum;
+    }
+}
+
+// Box kernels with running sums: every source row gets its horizontal
+// window sums from slidingSums, and the column totals over the last
+// kernelRows of them, kept in a ring, are updated by adding the row
+// entering the window and subtracting the one leaving it. The cost per
+// pixel does not depend on the kernel size. The totals times the box weight
+// equal the direct 2D sums exactly, so the rounding through divisor and
+// offset is unchanged.
+static void convolveBox(const ConvolutionRows &rows, int width, const Kernel &kernel, int firstRow, int lastRow)
 {
-    const int divisor = kernel.getDivisor();
-    const double factor = 1.0 / divisor;
-    const int bias = kernel.getOffset();
     const int offsetRow = kernel.getAnchorX();
     const int offsetCol = kernel.getAnchorY();
-    const int width = image.width();
-    const int height = image.height();
-    const QVector<QVector<int>> kernelTable = kernel.getKernel();
-    const int kernelSize = kernelTable.size();
-    QImage result = image;
+    const int kernelRows = kernel.getRows();
+    const int kernelCols = kernel.getCols();
+    const int weight = kernel.getBoxWeight();
+    const int paddedWidth = width + kernelCols - 1;
+    const int rowValues = width * 3;
 
-    for (int y = 0; y < height; ++y)
+    ImageBufferPool::Scratch<uchar> planes(3 * paddedWidth);
+    ImageBufferPool::Scratch<int> windowSums(kernelRows * rowValues);
+    ImageBufferPool::Scratch<int> totals(rowValues);
+    ImageBufferPool::Scratch<int> weighted(weight == 1 ? 0 : rowValues);
+    std::fill(totals.data(), totals.data() + totals.size(), 0);
+
+    const int passRows = lastRow - firstRow + kernelRows - 1;
+    for (int i = 0; i < passRows; ++i)
     {
-        for (int x = 0; x < width; ++x)
+        int *sums = windowSums.data() + (i % kernelRows) * rowValues;
+        if (i >= kernelRows)
+            ConvolutionKernels::multiplyAccumulate(totals.data(), sums, -1, rowValues);
+        rows.loadRow(firstRow - offsetRow + i, offsetCol, paddedWidth, planes.data(), planes.data() + paddedWidth,
+                     planes.data() + 2 * paddedWidth);
+        for (int channel = 0; channel < 3; ++channel)
+            slidingSums(planes.constData() + channel * paddedWidth, kernelCols, width, sums + channel * width);
+        ConvolutionKernels::multiplyAccumulate(totals.data(), sums, 1, rowValues);
+        if (i < kernelRows - 1)
+            continue;
+
+        const int *rowTotals = totals.constData();
+        if (weight != 1)
         {
-            int r = 0, g = 0, b = 0;
-            for (int ky = 0; ky < kernelSize; ++ky)
+            std::fill(weighted.data(), weighted.data() + weighted.size(), 0);
+            ConvolutionKernels::multiplyAccumulate(weighted.data(), totals.constData(), weight, rowValues);
+            rowTotals = weighted.constData();
+        }
+        rows.storeRow(firstRow + i - (kernelRows - 1), rowTotals, rowTotals + width, rowTotals + 2 * width);
+    }
+}
+
+// The power-of-two transform size of convolveFft's tiles in each direction
+// with the least work per result pixel: a transform of size n yields
+// n - kernel size + 1 results, but no more than the band has rows and the
+// image has columns.
+static QSize fftTransformSize(int kernelRows, int kernelCols, int bandRows, int width)
+{
+    QSize best;
+    double bestCost = 0;
+    for (int rows = Fft::nextPowerOfTwo(kernelRows); rows <= FFT_CONVOLUTION_MAX_SIZE; rows *= 2)
+    {
+        for (int cols = Fft::nextPowerOfTwo(kernelCols); cols <= FFT_CONVOLUTION_MAX_SIZE; cols *= 2)
+        {
+            const double results = double(qMin(rows - kernelRows + 1, bandRows)) * qMin(cols - kernelCols + 1, width);
+            const double cost = double(rows) * cols * std::log2(double(rows) * cols) / results;
+            if (best.isEmpty() || cost < bestCost)
             {
-                for (int kx = 0; kx < kernelSize; ++kx)
-                {
-                    int pixelX = qBound(0, x + kx - offsetCol, width - 1);
-                    int pixelY = qBound(0, y + ky - offsetRow, height - 1);
-                    QColor pixelColor = image.pixelColor(pixelX, pixelY);
-                    r += pixelColor.red() * kernelTable[ky][kx];
-                    g += pixelColor.green() * kernelTable[ky][kx];
-                    b += pixelColor.blue() * kernelTable[ky][kx];
-                }
+                best = QSize(cols, rows);
+                bestCost = cost;
             }
-            r = qBound(0, static_cast<int>(factor * r + bias), 255);
-            g = qBound(0, static_cast<int>(factor * g + bias), 255);
-            b = qBound(0, static_cast<int>(factor * b + bias), 255);
-            result.setPixelColor(x, y, QColor(r, g, b));
         }
     }
-    return result;
+    return best;
 }
 
-QImage ImageProcessor::applyMedianFilter(const QImage &image, int kernelSize)
+// Convolution through the FFT, for kernels too large to run directly: the
+// band is cut into tiles, and each tile's padded planes, with the halo the
+// kernel reaches, are transformed, multiplied by the kernel's spectrum and
+// transformed back (overlap-save, so bands and tiles need nothing from each
+// other). For any kernel whose integer sums fit in an int the transforms
+// stay many orders of magnitude closer than 0.5 to them, so rounding gives
+// the direct 2D sums exactly and the rounding through divisor and offset
+// is unchanged.
+static void convolveFft(const ConvolutionRows &rows, int width, const Kernel &kernel, int firstRow, int lastRow)
 {
-    const int width = image.width();
-    const int height = image.height();
-    const int halfKernelSize = kernelSize / 2;
-    QImage result = image;
+    using Complex = Fft::Complex;
+    const int offsetRow = kernel.getAnchorX();
+    const int offsetCol = kernel.getAnchorY();
+    const int kernelRows = kernel.getRows();
+    const int kernelCols = kernel.getCols();
+    const int paddedWidth = width + kernelCols - 1;
+
+    const int sourceRows = lastRow - firstRow + kernelRows - 1;
+    ImageBufferPool::Scratch<uchar> planes(sourceRows * 3 * paddedWidth);
+    for (int i = 0; i < sourceRows; ++i)
+    {
+        uchar *red = planes.data() + i * 3 * paddedWidth;
+        rows.loadRow(firstRow - offsetRow + i, offsetCol, paddedWidth, red, red + paddedWidth, red + 2 * paddedWidth);
+    }
+
+    const QSize transformSize = fftTransformSize(kernelRows, kernelCols, lastRow - firstRow, width);
+    const int transformRows = transformSize.height();
+    const int transformCols = transformSize.width();
+    const int cells = transformRows * transformCols;
+    const int tileRows = transformRows - kernelRows + 1;
+    const int tileCols = transformCols - kernelCols + 1;
+    const Fft rowTransform(transformCols);
+    const Fft columnTransform(transformRows);
 
-    for (int y = 0; y < height; ++y)
+    // Result (i, j) of a tile is the sum over the taps of weight times
+    // source (i + row, j + col): a correlation, which the conjugate of the
+    // kernel's spectrum turns the product into. The inverse transform's
+    // 1 / cells is folded in here.
+    ImageBufferPool::Scratch<Complex> spectrum(cells);
+    std::fill(spectrum.data(), spectrum.data() + cells, Complex());
+    for (const Kernel::Tap &tap : kernel.getTaps())
+        spectrum[tap.row * transformCols + tap.col] = Complex(tap.weight, 0);
+    Fft::forward2D(spectrum.data(), rowTransform, columnTransform);
+    for (int i = 0; i < cells; ++i)
+        spectrum[i] = std::conj(spectrum[i]) / double(cells);
+
+    // Every tile row is taken apart into channel tiles, red, green and blue
+    // of each tile in turn, which go through the transforms two at a time
+    // as the real and imaginary parts: the kernel is real, so the two
+    // correlations come back apart. std::complex allows the parts to be
+    // addressed as an array of doubles.
+    const int tilesAcross = (width + tileCols - 1) / tileCols;
+    const int channelTiles = 3 * tilesAcross;
+    ImageBufferPool::Scratch<Complex> grid(cells);
+    const int rowValues = 3 * width;
+    ImageBufferPool::Scratch<int> sums(tileRows * rowValues);
+    for (int tileY = firstRow; tileY < lastRow; tileY += tileRows)
     {
-        for (int x = 0; x < width; ++x)
+        const int resultRows = qMin(tileRows, lastRow - tileY);
+        for (int pair = 0; pair < channelTiles; pair += 2)
         {
-            QVector<int> redValues;
-            QVector<int> greenValues;
-            QVector<int> blueValues;
-            for (int ky = 0; ky < kernelSize; ++ky)
+            const int parts = qMin(2, channelTiles - pair);
+            for (int i = 0; i < transformRows; ++i)
+            {
+                double *values = reinterpret_cast<double *>(grid.data() + i * transformCols);
+                std::fill(values, values + 2 * transformCols, 0.0);
+                const int source = tileY - firstRow + i;
+                if (source >= sourceRows)
+                    continue;
+                for (int part = 0; part < parts; ++part)
+                {
+                    const int tileX = (pair + part) / 3 * tileCols;
+                    const int channel = (pair + part) % 3;
+                    const uchar *plane = planes.constData() + (source * 3 + channel) * paddedWidth + tileX;
+                    const int inputCols = qMin(transformCols, paddedWidth - tileX);
+                    for (int j = 0; j < inputCols; ++j)
+                        values[2 * j + part] = plane[j];
+                }
+            }
+
+            Fft::forward2D(grid.data(), rowTransform, columnTransform);
+            Fft::multiply(grid.data(), spectrum.constData(), cells);
+            Fft::inverse2D(grid.data(), rowTransform, columnTransform);
+
+            for (int part = 0; part < parts; ++part)
             {
-                for (int kx = 0; kx < kernelSize; ++kx)
+                const int tileX = (pair + part) / 3 * tileCols;
+                const int channel = (pair + part) % 3;
+                const int resultCols = qMin(tileCols, width - tileX);
+                for (int i = 0; i < resultRows; ++i)
                 {
-                    int pixelX = qBound(0, x + kx - halfKernelSize, width - 1);
-                    int pixelY = qBound(0, y + ky - halfKernelSize, height - 1);
-                    QColor pixelColor = image.pixelColor(pixelX, pixelY);
-                    redValues.append(pixelColor.red());
-                    greenValues.append(pixelColor.green());
-                    blueValues.append(pixelColor.blue());
+                    const double *values = reinterpret_cast<const double *>(grid.constData() + i * transformCols);
+                    int *channelSums = sums.data() + i * rowValues + channel * width + tileX;
+                    for (int j = 0; j < resultCols; ++j)
+                        channelSums[j] = int(std::lround(values[2 * j + part]));
                 }
             }
-            std::sort(redValues.begin(), redValues.end());
-            std::sort(greenValues.begin(), greenValues.end());
-            std::sort(blueValues.begin(), blueValues.end());
-            int medianIndex = redValues.size() / 2;
-            result.setPixelColor(x, y, QColor(redValues[medianIndex], greenValues[medianIndex], blueValues[medianIndex]));
+        }
+        for (int i = 0; i < resultRows; ++i)
+        {
+            const int *red = sums.constData() + i * rowValues;
+            rows.storeRow(tileY + i, red, red + width, red + 2 * width);
         }
     }
+}
+
+// Whether convolveBand takes a band of bandRows through convolveFft. Bands
+// shorter than the kernel, as in FilterPipeline's strips, would spend most
+// of every transform on the halo, so they stay direct.
+static bool usesFft(const Kernel &kernel, int bandRows)
+{
+    return kernel.getTaps().size() >= ImageProcessor::fftThreshold() && bandRows >= kernel.getRows() &&
+           kernel.getRows() <= FFT_CONVOLUTION_MAX_SIZE / 2 && kernel.getCols() <= FFT_CONVOLUTION_MAX_SIZE / 2;
+}
+
+static void convolveBand(const ConvolutionRows &rows, int width, const Kernel &kernel, int firstRow, int lastRow)
+{
+    // A 3x3 kernel is cheapest through the window function even when it is a
+    // box or separable; from 5x5 on those paths win.
+    if (kernel.getRows() == 3 && kernel.getCols() == 3)
+        convolveDirect(rows, width, kernel, firstRow, lastRow);
+    else if (kernel.isBox())
+        convolveBox(rows, width, kernel, firstRow, lastRow);
+    else if (kernel.isSeparable() && kernel.getRows() > 1 && kernel.getCols() > 1)
+        convolveSeparable(rows, width, kernel, firstRow, lastRow);
+    else if (usesFft(kernel, lastRow - firstRow))
+        convolveFft(rows, width, kernel, firstRow, lastRow);
+    else
+        convolveDirect(rows, width, kernel, firstRow, lastRow);
+}
+
+static int convolutionHalo(const Kernel &kernel)
+{
+    return qMax(kernel.getAnchorX(), kernel.getRows() - 1 - kernel.getAnchorX());
+}
+
+void ImageProcessor::convolveRows(const ConstRowFunction &sourceRow, const RowFunction &resultRow, int width, int height,
+                                  const Kernel &kernel, int firstRow, int lastRow)
+{
+    convolveBand(packedRows(sourceRow, resultRow, width, height, kernel), width, kernel, firstRow, lastRow);
+}
+
+QImage ImageProcessor::applyConvolution(const QImage &image, const Kernel &kernel)
+{
+    const QImage source = PixelAccess::normalized(image);
+    QImage result = PixelAccess::createResult(source.size());
+    const PixelAccess::RowWriter<QRgb> resultRows = PixelAccess::rows(result);
+
+    TileScheduler::forEachBand(source.height(), convolutionHalo(kernel), [&](int firstRow, int lastRow)
+                               { convolveRows([&source](int y)
+                                              { return PixelAccess::constRow(source, y); },
+                                              resultRows, source.width(), source.height(), kernel, firstRow, lastRow); });
     return result;
 }
 
+QImage ImageProcessor::applyConvolution(QImage &&image, const Kernel &kernel)
+{
+    // filterInPlace keeps only the rows next to each output row; mirror and
+    // wrap borders read rows further away.
+    if (!kernel.getBorder().isLocal() || !PixelAccess::prepareInPlace(image))
+        return applyConvolution(static_cast<const QImage &>(image), kernel);
+
+    const int width = image.width();
+    const int height = image.height();
+    PixelAccess::filterInPlace(image, kernel.getAnchorX(), kernel.getRows() - 1 - kernel.getAnchorX(),
+                               [&](const ConstRowFunction &sourceRow, const RowFunction &resultRow, int firstRow, int lastRow)
+                               { convolveRows(sourceRow, resultRow, width, height, kernel, firstRow, lastRow); });
+    return std::move(image);
+}
+
+PlanarImage ImageProcessor::applyConvolution(const PlanarImage &image, const Kernel &kernel)
+{
+    PlanarImage result(image.size());
+    const ConvolutionRows rows = planarRows(image, result, kernel);
+    TileScheduler::forEachBand(image.height(), convolutionHalo(kernel), [&](int firstRow, int lastRow)
+                               { convolveBand(rows, image.width(), kernel, firstRow, lastRow); });
+    return result;
+}
+
+QImage ImageProcessor::applyMedianFilter(const QImage &image, int kernelSize, const Border &border)
+{
+    return MedianFilter::apply(image, kernelSize, border);
+}
+
+QImage ImageProcessor::applyMedianFilter(QImage &&image, int kernelSize, const Border &border)
+{
+    return MedianFilter::apply(std::move(image), kernelSize, border);
+}
+
+PlanarImage ImageProcessor::applyMedianFilter(const PlanarImage &image, int kernelSize, const Border &border)
+{
+    return MedianFilter::apply(image, kernelSize, border);
+}
+
+// One channel value dithered to k levels against a threshold in [0, 1).
+static int ditherValue(int value, float thresholdNorm, int k)
+{
+    float normalized = value / 255.0f;
+    float scaled = normalized * (k - 1);
+    int base = int(scaled);
+    float frac = scaled - base;
+
+    int quantized = base;
+    if (frac >= thresholdNorm)
+        quantized += 1;
+
+    quantized = std::clamp(quantized, 0, k - 1);
+    return (quantized * 255) / (k - 1);
+}
+
 QImage ImageProcessor::applyOrderedDithering(const QImage &image, int thresholdMapSize, int k)
 {
     QVector<QVector<int>> thresholdMap = getOrderedDitheringKernel(thresholdMapSize);
     int thresholdDivisor = thresholdMapSize * thresholdMapSize + 1;
 
-    QImage result(image.size(), image.format());
+    auto ditherChannel = [k](int value, float thresholdNorm)
+    { return ditherValue(value, thresholdNorm, k); };
 
     if (image.format() == QImage::Format_Grayscale8)
     {
-        for (int y = 0; y < image.height(); ++y)
-        {
-            for (int x = 0; x < image.width(); ++x)
+        QImage result = ImageBufferPool::createImage(image.size(), image.format());
+        const PixelAccess::RowWriter<uchar> resultRows = PixelAccess::rows<uchar>(result);
+        TileScheduler::forEachBand(image.height(), 0, [&](int firstRow, int lastRow)
+                                   {
+            for (int y = firstRow; y < lastRow; ++y)
             {
-                int gray = qGray(image.pixel(x, y));
-
-                int tx = x % thresholdMapSize;
-                int ty = y % thresholdMapSize;
-                float thresholdNorm = thresholdMap[ty][tx] / float(thresholdDivisor);
-
-                float normalized = gray / 255.0f;
-                float scaled = normalized * (k - 1);
-                int base = int(scaled);
-                float residual = scaled - base;
+                const uchar *src = image.constScanLine(y);
+                uchar *dst = resultRows(y);
+                const QVector<int> &thresholdRow = thresholdMap[y % thresholdMapSize];
+                for (int x = 0; x < image.width(); ++x)
+                {
+                    float thresholdNorm = thresholdRow[x % thresholdMapSize] / float(thresholdDivisor);
+                    dst[x] = static_cast<uchar>(ditherChannel(src[x], thresholdNorm));
+                }
+            } });
+        return result;
+    }
 
-                int quantized = base;
-                if (residual >= thresholdNorm)
-                    quantized += 1;
+    const QImage source = PixelAccess::normalized(image);
+    QImage result = PixelAccess::createResult(source.size());
+    const PixelAccess::RowWriter<QRgb> resultRows = PixelAccess::rows(result);
+    TileScheduler::forEachBand(source.height(), 0, [&](int firstRow, int lastRow)
+                               {
+        for (int y = firstRow; y < lastRow; ++y)
+        {
+            const QRgb *src = PixelAccess::constRow(source, y);
+            QRgb *dst = resultRows(y);
+            const QVector<int> &thresholdRow = thresholdMap[y % thresholdMapSize];
+            for (int x = 0; x < source.width(); ++x)
+            {
+                float thresholdNorm = thresholdRow[x % thresholdMapSize] / float(thresholdDivisor);
+                dst[x] = qRgb(ditherChannel(qRed(src[x]), thresholdNorm),
+                              ditherChannel(qGreen(src[x]), thresholdNorm),
+                              ditherChannel(qBlue(src[x]), thresholdNorm));
+            }
+        } });
 
-                quantized = std::clamp(quantized, 0, k - 1);
-                int ditheredGray = (quantized * 255) / (k - 1);
+    return result;
+}
 
-                result.setPixel(x, y, qRgb(ditheredGray, ditheredGray, ditheredGray));
-            }
-        }
-    }
-    else
-    {
-        for (int y = 0; y < image.height(); ++y)
+PlanarImage ImageProcessor::applyOrderedDithering(const PlanarImage &image, int thresholdMapSize, int k)
+{
+    const QVector<QVector<int>> thresholdMap = getOrderedDitheringKernel(thresholdMapSize);
+    const int thresholdDivisor = thresholdMapSize * thresholdMapSize + 1;
+    PlanarImage result(image.size());
+    TileScheduler::forEachBand(image.height(), 0, [&](int firstRow, int lastRow)
+                               {
+        ImageBufferPool::Scratch<float> thresholds(image.width());
+        for (int y = firstRow; y < lastRow; ++y)
         {
+            const QVector<int> &thresholdRow = thresholdMap[y % thresholdMapSize];
             for (int x = 0; x < image.width(); ++x)
+                thresholds[x] = thresholdRow[x % thresholdMapSize] / float(thresholdDivisor);
+            for (int channel = 0; channel < PlanarImage::CHANNELS; ++channel)
             {
-                QColor color = image.pixelColor(x, y);
+                const uchar *src = image.constRow(channel, y);
+                uchar *dst = result.row(channel, y);
+                for (int x = 0; x < image.width(); ++x)
+                    dst[x] = static_cast<uchar>(ditherValue(src[x], thresholds[x], k));
+            }
+        } });
+    return result;
+}
+
+QImage ImageProcessor::applyUniformQuantization(const QImage &image, int rLevels, int gLevels, int bLevels)
+{
+    return applyLookupTable(image, uniformQuantizationTable(rLevels, gLevels, bLevels));
+}
+
+QImage ImageProcessor::applyUniformQuantization(QImage &&image, int rLevels, int gLevels, int bLevels)
+{
+    return applyLookupTable(std::move(image), uniformQuantizationTable(rLevels, gLevels, bLevels));
+}
 
-                int tx = x % thresholdMapSize;
-                int ty = y % thresholdMapSize;
-                float thresholdNorm = thresholdMap[ty][tx] / float(thresholdDivisor);
+PlanarImage ImageProcessor::applyUniformQuantization(const PlanarImage &image, int rLevels, int gLevels, int bLevels)
+{
+    return applyLookupTable(image, uniformQuantizationTable(rLevels, gLevels, bLevels));
+}
 
-                auto ditherChannel = [&](int value) -> int
-                {
-                    float normalized = value / 255.0f;
-                    float scaled = normalized * (k - 1);
-                    int base = int(scaled);
-                    float frac = scaled - base;
+QImage ImageProcessor::applyGreyscaleFilter(const QImage &image)
+{
+    QImage result = image.convertToFormat(QImage::Format_Grayscale8);
+    return result;
+}
+
+static QRgb rgbToHsvPixel(QRgb pixel)
+{
+    int r = qRed(pixel);
+    int g = qGreen(pixel);
+    int b = qBlue(pixel);
 
-                    int quantized = base;
-                    if (frac >= thresholdNorm)
-                        quantized += 1;
+    double rNorm = r / 255.0;
+    double gNorm = g / 255.0;
+    double bNorm = b / 255.0;
 
-                    quantized = std::clamp(quantized, 0, k - 1);
-                    return (quantized * 255) / (k - 1);
-                };
+    double max = std::max({rNorm, gNorm, bNorm});
+    double min = std::min({rNorm, gNorm, bNorm});
+    double delta = max - min;
 
-                int r = ditherChannel(color.red());
-                int g = ditherChannel(color.green());
-                int b = ditherChannel(color.blue());
+    double h = 0, s = 0, v = max;
 
-                result.setPixelColor(x, y, QColor(r, g, b));
-            }
+    if (delta > 0)
+    {
+        if (max == rNorm)
+        {
+            h = fmod((gNorm - bNorm) / delta, 6);
+        }
+        else if (max == gNorm)
+        {
+            h = (bNorm - rNorm) / delta + 2;
+        }
+        else if (max == bNorm)
+        {
+            h = (rNorm - gNorm) / delta + 4;
+        }
+        h *= 60;
+        if (h < 0)
+        {
+            h += 360;
         }
+        s = delta / max;
     }
 
-    return result;
+    return qRgb(static_cast<int>(h / 360.0 * 255), static_cast<int>(s * 255), static_cast<int>(v * 255));
 }
 
-QImage ImageProcessor::applyUniformQuantization(const QImage &image, int rLevels, int gLevels, int bLevels)
+// V depends only on max(r, g, b) and S only on the maximum and minimum, so
+// both come from tables filled by rgbToHsvPixel itself.
+struct HsvTables
 {
-    QImage result = image.convertToFormat(QImage::Format_RGB888);
-
-    auto quantize = [](int value, int levels) -> int
-    {
-        if (levels <= 1)
-            return 0;
-        int quant = (value * (levels - 1)) / 255;
-        return (quant * 255) / (levels - 1);
-    };
+    uchar value[256];
+    uchar saturation[256][256];
+    // floor(2^32 / (6 * delta)) + 1: for the numerators hsvHue divides (below
+    // 2^19) multiplying by it and shifting gives the exact quotient.
+    quint32 hueReciprocal[256];
 
-    for (int y = 0; y < result.height(); ++y)
+    HsvTables()
     {
-        for (int x = 0; x < result.width(); ++x)
+        hueReciprocal[0] = 0;
+        for (int delta = 1; delta < 256; ++delta)
+            hueReciprocal[delta] = static_cast<quint32>((quint64(1) << 32) / (6 * delta) + 1);
+        for (int max = 0; max < 256; ++max)
         {
-            QColor color = result.pixelColor(x, y);
-
-            int r = quantize(color.red(), rLevels);
-            int g = quantize(color.green(), gLevels);
-            int b = quantize(color.blue(), bLevels);
-
-            result.setPixelColor(x, y, QColor(r, g, b));
+            value[max] = static_cast<uchar>(qBlue(rgbToHsvPixel(qRgb(max, 0, 0))));
+            for (int min = 0; min <= max; ++min)
+                saturation[max][min] = static_cast<uchar>(qGreen(rgbToHsvPixel(qRgb(max, min, min))));
         }
     }
+};
 
-    return result;
+static const HsvTables &hsvTables()
+{
+    static const HsvTables tables;
+    return tables;
 }
 
-QImage ImageProcessor::applyGreyscaleFilter(const QImage &image)
+// Hue in integers: the hue in degrees times 255 / 360 is t * 255 / (6 * delta)
+// with t the position in [0, 6 * delta) around the color wheel. Away from
+// exact multiples the truncated quotient equals rgbToHsvPixel's; on them the
+// double formula may land just below, so those (about 2% of all colors) are
+// left to it.
+static inline int hsvHue(const HsvTables &tables, int r, int g, int b, int max, int min)
 {
-    QImage result = image.convertToFormat(QImage::Format_Grayscale8);
-    return result;
+    const int delta = max - min;
+    if (delta == 0)
+        return 0;
+    int t = max == r ? g - b : max == g ? 2 * delta + b - r : 4 * delta + r - g;
+    if (t < 0)
+        t += 6 * delta;
+    const int numerator = t * 255;
+    const int denominator = 6 * delta;
+    const int hue = static_cast<int>((static_cast<quint64>(numerator) * tables.hueReciprocal[delta]) >> 32);
+    if (hue * denominator == numerator)
+        return qRed(rgbToHsvPixel(qRgb(r, g, b)));
+    return hue;
 }
 
-QImage ImageProcessor::convertToHSV(const QImage &image)
+// rgbToHsvPixel through the tables.
+static inline void hsvFromRgb(const HsvTables &tables, int r, int g, int b, uchar &h, uchar &s, uchar &v)
 {
-    QImage hsvImage(image.size(), QImage::Format_ARGB32);
-    for (int y = 0; y < image.height(); ++y)
-    {
-        for (int x = 0; x < image.width(); ++x)
-        {
-            QColor color = image.pixelColor(x, y);
-            int r = color.red();
-            int g = color.green();
-            int b = color.blue();
+    const int max = qMax(r, qMax(g, b));
+    const int min = qMin(r, qMin(g, b));
+    h = static_cast<uchar>(hsvHue(tables, r, g, b, max, min));
+    s = tables.saturation[max][min];
+    v = tables.value[max];
+}
 
-            double rNorm = r / 255.0;
-            double gNorm = g / 255.0;
-            double bNorm = b / 255.0;
+static QRgb hsvToRgbPixel(int h, int s, int v)
+{
+    double hNorm = h / 255.0 * 360.0;
+    double sNorm = s / 255.0;
+    double vNorm = v / 255.0;
 
-            double max = std::max({rNorm, gNorm, bNorm});
-            double min = std::min({rNorm, gNorm, bNorm});
-            double delta = max - min;
+    double hh = hNorm / 60.0;
+    int i = static_cast<int>(hh) % 6;
+    double f = hh - i;
 
-            double h = 0, s = 0, v = max;
+    double p = vNorm * (1 - sNorm);
+    double q = vNorm * (1 - f * sNorm);
+    double t = vNorm * (1 - (1 - f) * sNorm);
 
-            if (delta > 0)
-            {
-                if (max == rNorm)
-                {
-                    h = fmod((gNorm - bNorm) / delta, 6);
-                }
-                else if (max == gNorm)
-                {
-                    h = (bNorm - rNorm) / delta + 2;
-                }
-                else if (max == bNorm)
-                {
-                    h = (rNorm - gNorm) / delta + 4;
-                }
-                h *= 60;
-                if (h < 0)
-                {
-                    h += 360;
-                }
-                s = delta / max;
-            }
+    double rNorm = 0, gNorm = 0, bNorm = 0;
 
-            hsvImage.setPixelColor(x, y, QColor(static_cast<int>(h / 360.0 * 255), static_cast<int>(s * 255), static_cast<int>(v * 255)));
-        }
+    switch (i)
+    {
+    case 0:
+        rNorm = vNorm;
+        gNorm = t;
+        bNorm = p;
+        break;
+    case 1:
+        rNorm = q;
+        gNorm = vNorm;
+        bNorm = p;
+        break;
+    case 2:
+        rNorm = p;
+        gNorm = vNorm;
+        bNorm = t;
+        break;
+    case 3:
+        rNorm = p;
+        gNorm = q;
+        bNorm = vNorm;
+        break;
+    case 4:
+        rNorm = t;
+        gNorm = p;
+        bNorm = vNorm;
+        break;
+    case 5:
+        rNorm = vNorm;
+        gNorm = p;
+        bNorm = q;
+        break;
+    default:
+        break;
     }
-    return hsvImage;
+
+    int r = qBound(0, static_cast<int>(rNorm * 255), 255);
+    int g = qBound(0, static_cast<int>(gNorm * 255), 255);
+    int b = qBound(0, static_cast<int>(bNorm * 255), 255);
+
+    return qRgb(r, g, b);
+}
+
+// Produces a Grayscale8 plane from a packed image, one byte per pixel.
+template <typename ChannelOp>
+static QImage extractPlane(const QImage &image, ChannelOp op)
+{
+    const QImage source = PixelAccess::normalized(image);
+    QImage plane = ImageBufferPool::createImage(source.size(), QImage::Format_Grayscale8);
+    const PixelAccess::RowWriter<uchar> planeRows = PixelAccess::rows<uchar>(plane);
+    TileScheduler::forEachBand(source.height(), 0, [&](int firstRow, int lastRow)
+                               {
+        for (int y = firstRow; y < lastRow; ++y)
+        {
+            const QRgb *src = PixelAccess::constRow(source, y);
+            uchar *dst = planeRows(y);
+            for (int x = 0; x < source.width(); ++x)
+                dst[x] = static_cast<uchar>(op(src[x]));
+        } });
+    return plane;
+}
+
+QImage ImageProcessor::convertToHSV(const QImage &image)
+{
+    const HsvTables &tables = hsvTables();
+    return PixelAccess::mapPixels(image, [&tables](QRgb pixel)
+                                  {
+        uchar h, s, v;
+        hsvFromRgb(tables, qRed(pixel), qGreen(pixel), qBlue(pixel), h, s, v);
+        return qRgb(h, s, v); });
+}
+
+ImageProcessor::HSVPlanes ImageProcessor::splitHSV(const QImage &image)
+{
+    const HsvTables &tables = hsvTables();
+    const QImage source = PixelAccess::normalized(image);
+    PlanarImage hsv(source.size());
+    TileScheduler::forEachBand(source.height(), 0, [&](int firstRow, int lastRow)
+                               {
+        for (int y = firstRow; y < lastRow; ++y)
+        {
+            const QRgb *src = PixelAccess::constRow(source, y);
+            uchar *hRow = hsv.row(0, y);
+            uchar *sRow = hsv.row(1, y);
+            uchar *vRow = hsv.row(2, y);
+            for (int x = 0; x < source.width(); ++x)
+                hsvFromRgb(tables, qRed(src[x]), qGreen(src[x]), qBlue(src[x]), hRow[x], sRow[x], vRow[x]);
+        } });
+    return {hsv.plane(0), hsv.plane(1), hsv.plane(2)};
+}
+
+PlanarImage ImageProcessor::convertToHSV(const PlanarImage &image)
+{
+    const HsvTables &tables = hsvTables();
+    PlanarImage hsv(image.size());
+    TileScheduler::forEachBand(image.height(), 0, [&](int firstRow, int lastRow)
+                               {
+        for (int y = firstRow; y < lastRow; ++y)
+        {
+            const uchar *red = image.constRow(0, y);
+            const uchar *green = image.constRow(1, y);
+            const uchar *blue = image.constRow(2, y);
+            uchar *hRow = hsv.row(0, y);
+            uchar *sRow = hsv.row(1, y);
+            uchar *vRow = hsv.row(2, y);
+            for (int x = 0; x < image.width(); ++x)
+                hsvFromRgb(tables, red[x], green[x], blue[x], hRow[x], sRow[x], vRow[x]);
+        } });
+    return hsv;
 }
 
 QImage ImageProcessor::extractChannel(const QImage &hsvImage, ImageProcessor::Channel channel)
 {
-    QImage channelImage(hsvImage.size(), QImage::Format_Grayscale8);
-    for (int y = 0; y < hsvImage.height(); ++y)
+    int shift = 0;
+    switch (channel)
     {
-        for (int x = 0; x < hsvImage.width(); ++x)
-        {
-            QColor color = hsvImage.pixelColor(x, y);
-            int value = 0;
-            switch (channel)
-            {
-            case Channel::H:
-                value = color.red();
-                break;
-            case Channel::S:
-                value = color.green();
-                break;
-            case Channel::V:
-                value = color.blue();
-                break;
-            }
-            channelImage.setPixel(x, y, qRgb(value, value, value));
-        }
+    case Channel::H:
+        shift = 16;
+        break;
+    case Channel::S:
+        shift = 8;
+        break;
+    case Channel::V:
+        shift = 0;
+        break;
     }
-    return channelImage;
+    return extractPlane(hsvImage, [shift](QRgb pixel)
+                        { return (pixel >> shift) & 0xff; });
+}
+
+// Channel planes are usually Grayscale8 already; anything else is reduced to
+// qGray() of its pixels like QImage::pixel() based reads would.
+static QImage toGrayPlane(const QImage &image)
+{
+    if (image.format() == QImage::Format_Grayscale8)
+        return image;
+    return extractPlane(image, [](QRgb pixel)
+                        { return qGray(pixel); });
 }
 
 QImage ImageProcessor::convertHSVToRGB(const QImage &hChannel, const QImage &sChannel, const QImage &vChannel)
 {
-    QImage rgbImage(hChannel.size(), QImage::Format_ARGB32);
+    const QImage hPlane = toGrayPlane(hChannel);
+    const QImage sPlane = toGrayPlane(sChannel);
+    const QImage vPlane = toGrayPlane(vChannel);
+    QImage rgbImage = PixelAccess::createResult(hPlane.size());
+    const PixelAccess::RowWriter<QRgb> rgbRows = PixelAccess::rows(rgbImage);
 
-    for (int y = 0; y < hChannel.height(); ++y)
-    {
-        for (int x = 0; x < hChannel.width(); ++x)
+    TileScheduler::forEachBand(hPlane.height(), 0, [&](int firstRow, int lastRow)
+                               {
+        for (int y = firstRow; y < lastRow; ++y)
         {
-            int h = qGray(hChannel.pixel(x, y));
-            int s = qGray(sChannel.pixel(x, y));
-            int v = qGray(vChannel.pixel(x, y));
+            const uchar *hRow = hPlane.constScanLine(y);
+            const uchar *sRow = sPlane.constScanLine(y);
+            const uchar *vRow = vPlane.constScanLine(y);
+            QRgb *dst = rgbRows(y);
+            for (int x = 0; x < hPlane.width(); ++x)
+                dst[x] = hsvToRgbPixel(hRow[x], sRow[x], vRow[x]);
+        } });
 
-            double hNorm = h / 255.0 * 360.0;
-            double sNorm = s / 255.0;
-            double vNorm = v / 255.0;
+    return rgbImage;
+}
 
-            double hh = hNorm / 60.0;
-            int i = static_cast<int>(hh) % 6;
-            double f = hh - i;
+QImage ImageProcessor::convertHSVToRGB(const PlanarImage &hsvImage)
+{
+    return convertHSVToRGB(hsvImage.plane(0), hsvImage.plane(1), hsvImage.plane(2));
+}
 
-            double p = vNorm * (1 - sNorm);
-            double q = vNorm * (1 - f * sNorm);
-            double t = vNorm * (1 - (1 - f) * sNorm);
+// Runs filter on the part of image the region needs and pastes the region of
+// its result into image. Rows and columns the source rectangle cuts off are
+// treated by the filter like the image borders, but only within margins of
+// the cut, which lies outside the region. Filters with a mirror or wrap
+// border read more than margins at the image edges and are run on all of it.
+static QImage filterRegion(const QImage &image, const QRect &region, const QMargins &margins, int period, const Border &border,
+                           const std::function<QImage(const QImage &)> &filter)
+{
+    if (!border.isLocal())
+        return ImageProcessor::pasteRegion(image, region, filter(image), QPoint(0, 0));
+    const QRect source = ImageProcessor::regionSource(region, margins, period, image.size());
+    if (source.isEmpty())
+        return image;
+    return ImageProcessor::pasteRegion(image, region, filter(image.copy(source)), source.topLeft());
+}
 
-            double rNorm = 0, gNorm = 0, bNorm = 0;
+QImage ImageProcessor::applyLookupTable(const QImage &image, const LookupTable &table, const QRect &region)
+{
+    return filterRegion(image, region, QMargins(), 1, Border(), [&table](const QImage &source)
+                        { return applyLookupTable(source, table); });
+}
 
-            switch (i)
-            {
-            case 0:
-                rNorm = vNorm;
-                gNorm = t;
-                bNorm = p;
-                break;
-            case 1:
-                rNorm = q;
-                gNorm = vNorm;
-                bNorm = p;
-                break;
-            case 2:
-                rNorm = p;
-                gNorm = vNorm;
-                bNorm = t;
-                break;
-            case 3:
-                rNorm = p;
-                gNorm = q;
-                bNorm = vNorm;
-                break;
-            case 4:
-                rNorm = t;
-                gNorm = p;
-                bNorm = vNorm;
-                break;
-            case 5:
-                rNorm = vNorm;
-                gNorm = p;
-                bNorm = q;
-                break;
-            default:
-                break;
-            }
+QImage ImageProcessor::applyConvolution(const QImage &image, const Kernel &kernel, const QRect &region)
+{
+    const QMargins margins(kernel.getAnchorY(), kernel.getAnchorX(), kernel.getCols() - 1 - kernel.getAnchorY(),
+                           kernel.getRows() - 1 - kernel.getAnchorX());
+    return filterRegion(image, region, margins, 1, kernel.getBorder(), [&kernel](const QImage &source)
+                        { return applyConvolution(source, kernel); });
+}
 
-            int r = qBound(0, static_cast<int>(rNorm * 255), 255);
-            int g = qBound(0, static_cast<int>(gNorm * 255), 255);
-            int b = qBound(0, static_cast<int>(bNorm * 255), 255);
+QImage ImageProcessor::applyMedianFilter(const QImage &image, int kernelSize, const QRect &region, const Border &border)
+{
+    const int half = kernelSize / 2;
+    return filterRegion(image, region, QMargins(half, half, half, half), 1, border, [kernelSize, &border](const QImage &source)
+                        { return applyMedianFilter(source, kernelSize, border); });
+}
 
-            rgbImage.setPixelColor(x, y, QColor(r, g, b));
-        }
-    }
+QImage ImageProcessor::applyOrderedDithering(const QImage &image, int thresholdMapSize, int k, const QRect &region)
+{
+    return filterRegion(image, region, QMargins(), thresholdMapSize, Border(), [thresholdMapSize, k](const QImage &source)
+                        { return applyOrderedDithering(source, thresholdMapSize, k); });
+}
 
-    return rgbImage;
+QImage ImageProcessor::applyGreyscaleFilter(const QImage &image, const QRect &region)
+{
+    return filterRegion(image, region, QMargins(), 1, Border(), [](const QImage &source)
+                        { return applyGreyscaleFilter(source); });
+}
+
+QRect ImageProcessor::regionSource(const QRect &region, const QMargins &margins, int period, const QSize &imageSize)
+{
+    QRect source = region.intersected(QRect(QPoint(0, 0), imageSize));
+    if (source.isEmpty())
+        return QRect();
+    source = source.marginsAdded(margins).intersected(QRect(QPoint(0, 0), imageSize));
+    source.setLeft(source.left() / period * period);
+    source.setTop(source.top() / period * period);
+    return source;
+}
+
+QImage ImageProcessor::pasteRegion(const QImage &image, const QRect &region, const QImage &patch, const QPoint &patchOrigin)
+{
+    const QRect area = region.intersected(image.rect()).intersected(QRect(patchOrigin, patch.size()));
+    if (area.isEmpty())
+        return image;
+    // Results that differ in format from the image, such as greyscale on
+    // part of a colour image, are combined in WorkingFormat.
+    const bool sameFormat = image.format() == patch.format() && image.depth() >= 8;
+    QImage result = sameFormat ? image : PixelAccess::normalized(image);
+    const QImage source = sameFormat ? patch : PixelAccess::normalized(patch);
+    const int pixelBytes = result.depth() / 8;
+    for (int y = area.top(); y <= area.bottom(); ++y)
+    {
+        std::memcpy(result.scanLine(y) + area.left() * pixelBytes,
+                    source.constScanLine(y - patchOrigin.y()) + (area.left() - patchOrigin.x()) * pixelBytes,
+                    size_t(area.width()) * pixelBytes);
+    }
+    return result;
 }
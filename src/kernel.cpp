@@ -2,11 +2,23 @@
 #include <QFile>
 #include <QTextStream>
 #include <QString>
-#include <QMessageBox>
+#include <numeric>
+#include <stdexcept>
+#include <string>
 
 Kernel::Kernel(int rows, int cols, QVector<QVector<int>> kernel, int divisor, int offset, int anchorX, int anchorY)
-    : rows(rows), cols(cols), kernel(kernel), divisor(divisor), offset(offset), anchorX(anchorX), anchorY(anchorY)
+    : rows(rows), cols(cols), divisor(divisor), offset(offset), anchorX(anchorX), anchorY(anchorY)
 {
+    if (rows < 1 || cols < 1 || kernel.size() != rows)
+        throw std::runtime_error("Kernel must have at least one row and column");
+    coefficients.reserve(rows * cols);
+    for (const QVector<int> &kernelRow : kernel)
+    {
+        if (kernelRow.size() != cols)
+            throw std::runtime_error("Kernel rows must all have " + std::to_string(cols) + " coefficients");
+        coefficients.append(kernelRow);
+    }
+    initialize();
 }
 
 Kernel::Kernel()
@@ -25,20 +37,14 @@ Kernel::Kernel(QString filePath)
     QTextStream in(&file);
     int rows, cols;
     in >> rows >> cols;
+    if (in.status() != QTextStream::Ok || rows < 1 || cols < 1)
+        throw std::runtime_error("Invalid kernel size in filter file " + filePath.toStdString());
     this->rows = rows;
     this->cols = cols;
 
-    this->kernel = QVector<QVector<int>>(rows, QVector<int>(cols));
-
-    for (int r = 0; r < rows; ++r)
-    {
-        for (int c = 0; c < cols; ++c)
-        {
-            int value;
-            in >> value;
-            this->kernel[r][c] = value;
-        }
-    }
+    this->coefficients = QVector<int>(rows * cols);
+    for (int &value : this->coefficients)
+        in >> value;
 
     int divisor, offset;
     in >> divisor >> offset;
@@ -51,16 +57,123 @@ Kernel::Kernel(QString filePath)
     this->anchorX = anchorX;
     this->anchorY = anchorY;
 
+    if (in.status() != QTextStream::Ok)
+        throw std::runtime_error("Truncated filter file " + filePath.toStdString());
+
+    // Files written before border modes existed end here and clamp.
+    in.skipWhiteSpace();
+    if (!in.atEnd())
+    {
+        QString borderName;
+        in >> borderName;
+        border = Border::parse(borderName);
+    }
+
     file.close();
+    initialize();
 }
 
 Kernel::~Kernel()
 {
 }
 
+void Kernel::initialize()
+{
+    if (divisor == 0)
+        throw std::runtime_error("Kernel divisor must not be zero");
+    if (anchorX < 0 || anchorX >= rows || anchorY < 0 || anchorY >= cols)
+        throw std::runtime_error("Kernel anchor must lie inside the " + std::to_string(rows) + "x" + std::to_string(cols) + " kernel");
+
+    factor = 1.0 / divisor;
+    sum = 0;
+    taps.clear();
+    for (int r = 0; r < rows; ++r)
+    {
+        for (int c = 0; c < cols; ++c)
+        {
+            const int weight = at(r, c);
+            sum += weight;
+            if (weight != 0)
+                taps.append(Tap{r, c, weight});
+        }
+    }
+
+    boxWeight = coefficients[0];
+    for (int weight : coefficients)
+    {
+        if (weight != boxWeight)
+        {
+            boxWeight = 0;
+            break;
+        }
+    }
+
+    detectSeparability();
+}
+
+void Kernel::detectSeparability()
+{
+    separable = false;
+    horizontalKernel.clear();
+    verticalKernel.clear();
+
+    // Every row of a rank-1 integer matrix is an integer multiple of the same
+    // primitive vector, so take the first non-zero row reduced by its gcd as
+    // the horizontal factor and check that the rest of the matrix follows.
+    int pivotRow = -1;
+    for (int r = 0; r < rows && pivotRow < 0; ++r)
+    {
+        for (int c = 0; c < cols; ++c)
+        {
+            if (at(r, c) != 0)
+            {
+                pivotRow = r;
+                break;
+            }
+        }
+    }
+    if (pivotRow < 0)
+        return;
+
+    int gcd = 0;
+    int pivotCol = -1;
+    for (int c = 0; c < cols; ++c)
+    {
+        gcd = std::gcd(gcd, at(pivotRow, c));
+        if (pivotCol < 0 && at(pivotRow, c) != 0)
+            pivotCol = c;
+    }
+    if (at(pivotRow, pivotCol) < 0)
+        gcd = -gcd;
+
+    QVector<int> horizontal(cols);
+    for (int c = 0; c < cols; ++c)
+        horizontal[c] = at(pivotRow, c) / gcd;
+
+    QVector<int> vertical(rows);
+    for (int r = 0; r < rows; ++r)
+    {
+        if (at(r, pivotCol) % horizontal[pivotCol] != 0)
+            return;
+        vertical[r] = at(r, pivotCol) / horizontal[pivotCol];
+        for (int c = 0; c < cols; ++c)
+        {
+            if (at(r, c) != vertical[r] * horizontal[c])
+                return;
+        }
+    }
+
+    separable = true;
+    horizontalKernel = horizontal;
+    verticalKernel = vertical;
+}
+
 QVector<QVector<int>> Kernel::getKernel() const
 {
-    return kernel;
+    QVector<QVector<int>> table(rows);
+    for (int r = 0; r < rows; ++r)
+        table[r] = QVector<int>(row(r), row(r) + cols);
+    return table;
 }
 
 int Kernel::getDivisor() const
@@ -91,4 +204,72 @@ int Kernel::getRows() const
 int Kernel::getCols() const
 {
     return cols;
-}
\ No newline at end of file
+}
+
+const Border &Kernel::getBorder() const
+{
+    return border;
+}
+
+void Kernel::setBorder(const Border &border)
+{
+    this->border = border;
+}
+
+bool Kernel::isBox() const
+{
+    return boxWeight != 0;
+}
+
+int Kernel::getBoxWeight() const
+{
+    return boxWeight;
+}
+
+bool Kernel::isSeparable() const
+{
+    return separable;
+}
+
+double Kernel::getFactor() const
+{
+    return factor;
+}
+
+int Kernel::getSum() const
+{
+    return sum;
+}
+
+const QVector<Kernel::Tap> &Kernel::getTaps() const
+{
+    return taps;
+}
+
+const QVector<int> &Kernel::getHorizontalKernel() const
+{
+    return horizontalKernel;
+}
+
+const QVector<int> &Kernel::getVerticalKernel() const
+{
+    return verticalKernel;
+}
+
+Kernel Kernel::resampled(int newRows, int newCols) const
+{
+    newRows = qBound(1, newRows, rows);
+    newCols = qBound(1, newCols, cols);
+    if (newRows == rows && newCols == cols)
+        return *this;
+
+    QVector<QVector<int>> table(newRows, QVector<int>(newCols, 0));
+    for (int r = 0; r < rows; ++r)
+    {
+        for (int c = 0; c < cols; ++c)
+            table[r * newRows / rows][c * newCols / cols] += at(r, c);
+    }
+    Kernel kernel(newRows, newCols, table, divisor, offset, anchorX * newRows / rows, anchorY * newCols / cols);
+    kernel.setBorder(border);
+    return kernel;
+}
@@ -0,0 +1,114 @@
+#include "lookuptable.h"
+#include "imagebufferpool.h"
+#include "pixelaccess.h"
+#include "tilescheduler.h"
+
+LookupTable::LookupTable()
+    : LookupTable([](int value)
+                  { return value; })
+{
+}
+
+LookupTable::LookupTable(const ChannelFunction &function)
+    : redTable(build(function)), greenTable(redTable), blueTable(redTable)
+{
+}
+
+LookupTable::LookupTable(const ChannelFunction &red, const ChannelFunction &green, const ChannelFunction &blue)
+    : redTable(build(red)), greenTable(build(green)), blueTable(build(blue))
+{
+}
+
+LookupTable::Table LookupTable::build(const ChannelFunction &function)
+{
+    Table table;
+    for (int value = 0; value < 256; ++value)
+        table[value] = static_cast<uchar>(qBound(0, function(value), 255));
+    return table;
+}
+
+LookupTable LookupTable::then(const LookupTable &next) const
+{
+    LookupTable composed;
+    for (int value = 0; value < 256; ++value)
+    {
+        composed.redTable[value] = next.redTable[redTable[value]];
+        composed.greenTable[value] = next.greenTable[greenTable[value]];
+        composed.blueTable[value] = next.blueTable[blueTable[value]];
+    }
+    return composed;
+}
+
+bool LookupTable::isIdentity() const
+{
+    for (int value = 0; value < 256; ++value)
+    {
+        if (redTable[value] != value || greenTable[value] != value || blueTable[value] != value)
+            return false;
+    }
+    return true;
+}
+
+bool LookupTable::isGray() const
+{
+    return redTable == greenTable && redTable == blueTable;
+}
+
+QImage LookupTable::apply(const QImage &image) const
+{
+    // A gray table maps gray pixels to gray pixels, so Grayscale8 input can
+    // stay one byte per pixel.
+    if (image.format() == QImage::Format_Grayscale8 && isGray())
+    {
+        QImage result = ImageBufferPool::createImage(image.size(), QImage::Format_Grayscale8);
+        const PixelAccess::RowWriter<uchar> resultRows = PixelAccess::rows<uchar>(result);
+        TileScheduler::forEachBand(image.height(), 0, [&](int firstRow, int lastRow)
+                                   {
+            for (int y = firstRow; y < lastRow; ++y)
+            {
+                const uchar *src = image.constScanLine(y);
+                uchar *dst = resultRows(y);
+                for (int x = 0; x < image.width(); ++x)
+                    dst[x] = redTable[src[x]];
+            } });
+        return result;
+    }
+
+    return PixelAccess::mapPixels(image, [this](QRgb pixel)
+                                  { return qRgb(redTable[qRed(pixel)], greenTable[qGreen(pixel)], blueTable[qBlue(pixel)]); });
+}
+
+QImage LookupTable::apply(QImage &&image) const
+{
+    if (image.format() == QImage::Format_Grayscale8 && isGray() && image.isDetached())
+    {
+        const PixelAccess::RowWriter<uchar> imageRows = PixelAccess::rows<uchar>(image);
+        TileScheduler::forEachBand(image.height(), 0, [&](int firstRow, int lastRow)
+                                   {
+            for (int y = firstRow; y < lastRow; ++y)
+                mapChannelRow(0, imageRows(y), imageRows(y), image.width()); });
+        return std::move(image);
+    }
+    if (!PixelAccess::prepareInPlace(image))
+        return apply(static_cast<const QImage &>(image));
+
+    const PixelAccess::RowWriter<QRgb> imageRows = PixelAccess::rows(image);
+    TileScheduler::forEachBand(image.height(), 0, [&](int firstRow, int lastRow)
+                               {
+        for (int y = firstRow; y < lastRow; ++y)
+            mapRow(imageRows(y), imageRows(y), image.width()); });
+    return std::move(image);
+}
+
+void LookupTable::mapRow(const QRgb *src, QRgb *dst, int count) const
+{
+    for (int x = 0; x < count; ++x)
+        dst[x] = qRgb(redTable[qRed(src[x])], greenTable[qGreen(src[x])], blueTable[qBlue(src[x])]);
+}
+
+void LookupTable::mapChannelRow(int channel, const uchar *src, uchar *dst, int count) const
+{
+    const Table &table = channel == 0 ? redTable : channel == 1 ? greenTable : blueTable;
+    for (int x = 0; x < count; ++x)
+        dst[x] = table[src[x]];
+}
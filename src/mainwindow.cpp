@@ -2,14 +2,23 @@
 #include "imageprocessor.h"
 #include "filterconstants.h"
 #include "filtereditordialog.h"
+#include "filterpipeline.h"
 #include <QMessageBox>
 #include <QStackedWidget>
 #include <iostream>
 #include <QScrollArea>
+#include <QScrollBar>
+#include <QStatusBar>
+#include <QMouseEvent>
+#include <QPainter>
+
+// Longest side of the preview, the size of the image views.
+static const int PREVIEW_SIZE = 500;
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), originalImageLabel(new QLabel(this)), filteredImageLabel(new QLabel(this)), HfilteredImageLabel(new QLabel(this)),
-      VfilteredImageLabel(new QLabel(this)), SfilteredImageLabel(new QLabel(this)), RGBfilteredImageLabel(new QLabel(this))
+      VfilteredImageLabel(new QLabel(this)), SfilteredImageLabel(new QLabel(this)), RGBfilteredImageLabel(new QLabel(this)),
+      history(HISTORY_CACHE_LIMIT), filterCache(FILTER_CACHE_LIMIT)
 {
     try
     {
@@ -36,7 +45,7 @@ MainWindow::MainWindow(QWidget *parent)
         int rows = kernel.size();
         int cols = kernel[0].size();
 
-        gaussianBlurKernel = Kernel(rows, cols, kernel, BLUR_DIVISOR, BLUR_OFFSET, BLUR_ANCHOR_X, BLUR_ANCHOR_Y);
+        gaussianBlurKernel = Kernel(rows, cols, kernel, GAUSSIAN_BLUR_DIVISOR, GAUSSIAN_BLUR_OFFSET, GAUSSIAN_BLUR_ANCHOR_X, GAUSSIAN_BLUR_ANCHOR_Y);
     }
 
     try
@@ -50,7 +59,7 @@ MainWindow::MainWindow(QWidget *parent)
         int rows = kernel.size();
         int cols = kernel[0].size();
 
-        sharpenKernel = Kernel(rows, cols, kernel, BLUR_DIVISOR, BLUR_OFFSET, BLUR_ANCHOR_X, BLUR_ANCHOR_Y);
+        sharpenKernel = Kernel(rows, cols, kernel, SHARPEN_DIVISOR, SHARPEN_OFFSET, SHARPEN_ANCHOR_X, SHARPEN_ANCHOR_Y);
     }
 
     try
@@ -64,7 +73,7 @@ MainWindow::MainWindow(QWidget *parent)
         int rows = kernel.size();
         int cols = kernel[0].size();
 
-        edgeDetectionKernel = Kernel(rows, cols, kernel, BLUR_DIVISOR, BLUR_OFFSET, BLUR_ANCHOR_X, BLUR_ANCHOR_Y);
+        edgeDetectionKernel = Kernel(rows, cols, kernel, EDGE_DETECTION_DIVISOR, EDGE_DETECTION_OFFSET, EDGE_DETECTION_ANCHOR_X, EDGE_DETECTION_ANCHOR_Y);
     }
 
     try
@@ -78,7 +87,7 @@ MainWindow::MainWindow(QWidget *parent)
         int rows = kernel.size();
         int cols = kernel[0].size();
 
-        embossKernel = Kernel(rows, cols, kernel, BLUR_DIVISOR, BLUR_OFFSET, BLUR_ANCHOR_X, BLUR_ANCHOR_Y);
+        embossKernel = Kernel(rows, cols, kernel, EMBOSS_DIVISOR, EMBOSS_OFFSET, EMBOSS_ANCHOR_X, EMBOSS_ANCHOR_Y);
     }
 
     // --- Image view setup ---
@@ -122,9 +131,21 @@ MainWindow::MainWindow(QWidget *parent)
     QPushButton *loadButton = new QPushButton("Load Image", this);
     QPushButton *saveButton = new QPushButton("Save Image", this);
     QPushButton *resetButton = new QPushButton("Reset Image", this);
+    undoButton = new QPushButton("Undo", this);
+    undoButton->setShortcut(QKeySequence::Undo);
+    undoButton->setEnabled(false);
+    redoButton = new QPushButton("Redo", this);
+    redoButton->setShortcut(QKeySequence::Redo);
+    redoButton->setEnabled(false);
     buttonLayout->addWidget(loadButton);
     buttonLayout->addWidget(saveButton);
     buttonLayout->addWidget(resetButton);
+    buttonLayout->addWidget(undoButton);
+    buttonLayout->addWidget(redoButton);
+    regionCheckBox = new QCheckBox("Refine visible area only", this);
+    regionCheckBox->setToolTip("Apply filters at full resolution only to the visible part of the image, or to an area dragged on it.\n"
+                               "The rest is filtered when scrolled into view or when the image is saved.");
+    buttonLayout->addWidget(regionCheckBox);
 
     // --- Image display ---
     QHBoxLayout *imageLayout = new QHBoxLayout();
@@ -235,10 +256,39 @@ MainWindow::MainWindow(QWidget *parent)
     setCentralWidget(centralWidget);
     setWindowTitle("Image Filter Application");
 
+    // --- Filter progress ---
+    filterProgressBar = new QProgressBar(this);
+    filterProgressBar->setRange(0, 100);
+    filterProgressBar->setMaximumWidth(200);
+    filterProgressBar->hide();
+    cancelFilterButton = new QPushButton("Cancel", this);
+    cancelFilterButton->hide();
+    statusBar()->addPermanentWidget(filterProgressBar);
+    statusBar()->addPermanentWidget(cancelFilterButton);
+    connect(cancelFilterButton, &QPushButton::clicked, this, &MainWindow::cancelFilter);
+
+    // --- Region mode ---
+    selectionBand = new QRubberBand(QRubberBand::Rectangle, filteredImageLabel);
+    filteredImageLabel->installEventFilter(this);
+    connect(regionCheckBox, &QCheckBox::toggled, this, &MainWindow::setRegionMode);
+    for (QScrollBar *scrollBar : {filteredImageScrollArea->horizontalScrollBar(), filteredImageScrollArea->verticalScrollBar()})
+    {
+        connect(scrollBar, &QScrollBar::valueChanged, this, [this]()
+                {
+            if (regionCheckBox->isChecked())
+                startRegionRefinement(); });
+    }
+
+    // One filter and the HSV previews can run side by side; a cancelled
+    // filter finishes its current band before the next one starts.
+    filterPool.setMaxThreadCount(2);
+
     // --- Connections ---
     connect(loadButton, &QPushButton::clicked, this, &MainWindow::loadImage);
     connect(saveButton, &QPushButton::clicked, this, &MainWindow::saveImage);
     connect(resetButton, &QPushButton::clicked, this, &MainWindow::resetImage);
+    connect(undoButton, &QPushButton::clicked, this, &MainWindow::undoFilter);
+    connect(redoButton, &QPushButton::clicked, this, &MainWindow::redoFilter);
     connect(invertButton, &QPushButton::clicked, this, &MainWindow::applyInversionFilter);
     connect(brightnessButton, &QPushButton::clicked, this, &MainWindow::applyBrightnessFilter);
     connect(contrastButton, &QPushButton::clicked, this, &MainWindow::applyContrastFilter);
@@ -249,22 +299,59 @@ MainWindow::MainWindow(QWidget *parent)
     adjustSize();
 }
 
-MainWindow::~MainWindow() {}
+MainWindow::~MainWindow()
+{
+    discardPendingFilters();
+    cancelHSVFilter();
+    filterPool.waitForDone();
+}
+
+// Dragging on the filtered view in region mode selects the area to refine;
+// a click without dragging clears the selection. The view shows the
+// preview, so the selection is mapped back to image coordinates.
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched != filteredImageLabel || !regionCheckBox->isChecked() || originalImage.isNull())
+        return QMainWindow::eventFilter(watched, event);
+
+    switch (event->type())
+    {
+    case QEvent::MouseButtonPress:
+        selectionStart = static_cast<QMouseEvent *>(event)->position().toPoint();
+        selectionBand->setGeometry(QRect(selectionStart, QSize()));
+        selectionBand->show();
+        return true;
+    case QEvent::MouseMove:
+        selectionBand->setGeometry(QRect(selectionStart, static_cast<QMouseEvent *>(event)->position().toPoint()).normalized());
+        return true;
+    case QEvent::MouseButtonRelease:
+        selection = viewToImage(selectionBand->geometry());
+        if (selection.width() < 2 || selection.height() < 2)
+        {
+            selection = QRect();
+            selectionBand->hide();
+        }
+        startRegionRefinement();
+        return true;
+    default:
+        return QMainWindow::eventFilter(watched, event);
+    }
+}
 
 void MainWindow::loadImage()
 {
     QString fileName = QFileDialog::getOpenFileName(this, "Open Image", "", "Images (*.png *.jpg *.bmp)");
     if (!fileName.isEmpty())
     {
+        cancelHSVFilter();
         originalImage.load(fileName);
         originalPixmap = QPixmap::fromImage(originalImage);
-        filteredImage = originalImage;
+        previewScale = originalImage.isNull() ? 1.0 : qMin(1.0, double(PREVIEW_SIZE) / qMax(originalImage.width(), originalImage.height()));
 
         originalImageLabel->setPixmap(originalPixmap);
-        filteredImageLabel->setPixmap(originalPixmap);
-
         originalImageLabel->setFixedSize(originalPixmap.size());
-        filteredImageLabel->setFixedSize(originalPixmap.size());
+        resetHistory();
+        filteredImageLabel->setFixedSize(previewImage.size());
 
         applyHSVFilter();
     }
@@ -278,12 +365,36 @@ void MainWindow::saveImage()
         return;
     }
     QString fileName = QFileDialog::getSaveFileName(this, "Save Image", "", "Images (*.png *.jpg *.bmp)");
-    if (!fileName.isEmpty())
+    if (fileName.isEmpty())
+        return;
+
+    // A running whole-image refinement applies a prefix of the pending
+    // filters, so it is kept; a region refinement is replaced by one.
+    const bool refiningWholeImage = filterTask && (!regionCheckBox->isChecked() || !saveFileName.isEmpty());
+    saveFileName = fileName;
+    saveState = history.position();
+    if (pendingFilters.isEmpty())
+    {
+        saveFilteredImage();
+        return;
+    }
+    if (!refiningWholeImage)
     {
-        filteredImage.save(fileName);
+        cancelRefinement();
+        startRefinement();
     }
 }
 
+// Writes filteredImage, now history state saveState, to saveFileName.
+void MainWindow::saveFilteredImage()
+{
+    if (filteredImage.save(saveFileName))
+        statusBar()->showMessage("Saved " + saveFileName, 2000);
+    else
+        QMessageBox::warning(this, "Error", "Could not save " + saveFileName + ".");
+    saveFileName.clear();
+}
+
 void MainWindow::resetImage()
 {
     if (originalImage.isNull())
@@ -291,16 +402,77 @@ void MainWindow::resetImage()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
+    resetHistory();
+}
+
+void MainWindow::undoFilter()
+{
+    if (!history.canUndo())
+        return;
+    history.undo();
+    showHistoryState();
+}
+
+void MainWindow::redoFilter()
+{
+    if (!history.canRedo())
+        return;
+    history.redo();
+    showHistoryState();
+}
+
+// Starts a new history at the original image.
+void MainWindow::resetHistory()
+{
+    discardPendingFilters();
+    selection = QRect();
+    selectionBand->hide();
+    history.reset(originalImage);
+    committedState = 0;
     filteredImage = originalImage;
-    QPixmap scaledPixmap = QPixmap::fromImage(filteredImage).scaled(filteredImageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    filteredImageLabel->setPixmap(scaledPixmap);
+    previewImage = scaledForPreview(originalImage);
+    previewStates = {previewImage};
+    showPreview();
+    updateHistoryButtons();
 }
 
-void MainWindow::updateFilteredImage(const QImage &newImage)
+// Shows the current history state: its preview at once, and its
+// full-resolution image from the history cache, replaying the filters after
+// the nearest cached state in the background if it was evicted.
+void MainWindow::showHistoryState()
 {
-    filteredImage = newImage;
-    QPixmap scaledPixmap = QPixmap::fromImage(filteredImage).scaled(filteredImageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    filteredImageLabel->setPixmap(scaledPixmap);
+    discardPendingFilters();
+    const int state = history.position();
+    previewImage = previewStates[state];
+    updateHistoryButtons();
+
+    showPreview();
+
+    // Without a separate preview the preview states are the results.
+    if (previewScale >= 1.0)
+    {
+        committedState = state;
+        filteredImage = previewImage;
+        return;
+    }
+
+    // filteredImage is still the best start when it is an earlier state than
+    // anything cached, e.g. after cancelling.
+    const int cachedState = history.nearestCached(state);
+    if (committedState > state || committedState < cachedState)
+    {
+        committedState = cachedState;
+        filteredImage = history.cached(cachedState);
+    }
+    pendingFilters = history.operations(committedState, state);
+    if (!pendingFilters.isEmpty())
+        startRefinement();
+}
+
+void MainWindow::updateHistoryButtons()
+{
+    undoButton->setEnabled(history.canUndo());
+    redoButton->setEnabled(history.canRedo());
 }
 
 void MainWindow::applyInversionFilter()
@@ -310,7 +482,7 @@ void MainWindow::applyInversionFilter()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::invertColors(filteredImage));
+    startFilter(FilterOperation::invert());
 }
 
 void MainWindow::applyBrightnessFilter()
@@ -320,7 +492,7 @@ void MainWindow::applyBrightnessFilter()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::adjustBrightness(filteredImage));
+    startFilter(FilterOperation::brightness());
 }
 
 void MainWindow::applyContrastFilter()
@@ -330,7 +502,7 @@ void MainWindow::applyContrastFilter()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::adjustContrast(filteredImage));
+    startFilter(FilterOperation::contrast());
 }
 
 void MainWindow::applyGammaCorrectionFilter()
@@ -340,7 +512,7 @@ void MainWindow::applyGammaCorrectionFilter()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::gammaCorrection(filteredImage));
+    startFilter(FilterOperation::gamma());
 }
 
 void MainWindow::applyBlurFilter()
@@ -350,7 +522,7 @@ void MainWindow::applyBlurFilter()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::applyConvolution(filteredImage, blurKernel));
+    startFilter(FilterOperation::convolution(blurKernel, "blur"));
 }
 
 void MainWindow::applyGaussianBlurFilter()
@@ -360,7 +532,7 @@ void MainWindow::applyGaussianBlurFilter()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::applyConvolution(filteredImage, gaussianBlurKernel));
+    startFilter(FilterOperation::convolution(gaussianBlurKernel, "gaussian_blur"));
 }
 
 void MainWindow::applySharpenFilter()
@@ -370,7 +542,7 @@ void MainWindow::applySharpenFilter()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::applyConvolution(filteredImage, sharpenKernel));
+    startFilter(FilterOperation::convolution(sharpenKernel, "sharpen"));
 }
 
 void MainWindow::applyEdgeDetectionFilter()
@@ -380,7 +552,7 @@ void MainWindow::applyEdgeDetectionFilter()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::applyConvolution(filteredImage, edgeDetectionKernel));
+    startFilter(FilterOperation::convolution(edgeDetectionKernel, "edge_detection"));
 }
 
 void MainWindow::applyEmbossFilter()
@@ -390,7 +562,7 @@ void MainWindow::applyEmbossFilter()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::applyConvolution(filteredImage, embossKernel));
+    startFilter(FilterOperation::convolution(embossKernel, "emboss"));
 }
 
 void MainWindow::openFilterEditorDialog()
@@ -403,9 +575,7 @@ void MainWindow::openFilterEditorDialog()
 
     FilterEditorDialog dialog(this);
     connect(&dialog, &FilterEditorDialog::filterApplied, this, [this](Kernel kernel)
-            {
-        QImage newImage = ImageProcessor::applyConvolution(originalImage, kernel);
-        updateFilteredImage(newImage); });
+            { startFilter(FilterOperation::convolution(kernel, "custom")); });
     dialog.exec();
 }
 
@@ -416,7 +586,7 @@ void MainWindow::applyMedianFilter()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::applyMedianFilter(filteredImage, medianSpinBox->value()));
+    startFilter(FilterOperation::median(medianSpinBox->value()));
 }
 
 void MainWindow::applyOrderedDithering()
@@ -426,7 +596,7 @@ void MainWindow::applyOrderedDithering()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::applyOrderedDithering(filteredImage, orderedDitheringComboBox->currentData().toInt(), ditheringQuantizationSpinBox->value()));
+    startFilter(FilterOperation::orderedDithering(orderedDitheringComboBox->currentData().toInt(), ditheringQuantizationSpinBox->value()));
 }
 
 void MainWindow::applyUniformQuantization()
@@ -436,7 +606,7 @@ void MainWindow::applyUniformQuantization()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::applyUniformQuantization(filteredImage, rQuantSpinBox->value(), gQuantSpinBox->value(), bQuantSpinBox->value()));
+    startFilter(FilterOperation::uniformQuantization(rQuantSpinBox->value(), gQuantSpinBox->value(), bQuantSpinBox->value()));
 }
 
 void MainWindow::applySelectedConvolutionFilter()
@@ -486,7 +656,7 @@ void MainWindow::applyGreyscaleFilter()
         QMessageBox::warning(this, "Error", "No image loaded.");
         return;
     }
-    updateFilteredImage(ImageProcessor::applyGreyscaleFilter(filteredImage));
+    startFilter(FilterOperation::greyscale());
 }
 
 void MainWindow::applyHSVFilter()
@@ -497,16 +667,344 @@ void MainWindow::applyHSVFilter()
         return;
     }
 
-    QImage hsvImage = ImageProcessor::convertToHSV(originalImage);
+    cancelHSVFilter();
+    const quint64 generation = ++hsvGeneration;
+    // splitHSV and convertHSVToRGB.
+    auto task = std::make_shared<TileScheduler::Task>(2);
+    hsvTask = task;
+    // The channels are only shown as thumbnails, so they are computed from
+    // the preview-sized copy rather than the full image.
+    const QImage source = scaledForPreview(originalImage);
+
+    filterPool.start([this, task, source, generation]()
+                     {
+        QImage hChannel, sChannel, vChannel, rgbImage;
+        try
+        {
+            TileScheduler::TaskScope scope(task.get());
+            const ImageProcessor::HSVPlanes planes = ImageProcessor::splitHSV(source);
+            hChannel = planes.h;
+            sChannel = planes.s;
+            vChannel = planes.v;
+            rgbImage = ImageProcessor::convertHSVToRGB(hChannel, sChannel, vChannel);
+        }
+        catch (const std::exception &)
+        {
+            return;
+        }
+
+        QMetaObject::invokeMethod(this, [this, generation, hChannel, sChannel, vChannel, rgbImage]()
+                                  {
+            if (generation != hsvGeneration)
+                return;
+            hsvTask.reset();
+            HfilteredImageLabel->setPixmap(QPixmap::fromImage(hChannel).scaled(HfilteredImageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            SfilteredImageLabel->setPixmap(QPixmap::fromImage(sChannel).scaled(SfilteredImageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            VfilteredImageLabel->setPixmap(QPixmap::fromImage(vChannel).scaled(VfilteredImageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            RGBfilteredImageLabel->setPixmap(QPixmap::fromImage(rgbImage).scaled(RGBfilteredImageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation)); }, Qt::QueuedConnection); });
+}
+
+void MainWindow::cancelHSVFilter()
+{
+    if (hsvTask)
+        hsvTask->cancel();
+    hsvTask.reset();
+    ++hsvGeneration;
+}
+
+QImage MainWindow::scaledForPreview(const QImage &image) const
+{
+    if (previewScale >= 1.0)
+        return image;
+    return image.scaled(image.size() * previewScale, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+// Shows the preview of the current state at its own size, with no
+// full-resolution pixels painted over it yet.
+void MainWindow::showPreview()
+{
+    filteredPixmap = QPixmap::fromImage(previewImage);
+    filteredImageLabel->setPixmap(filteredPixmap);
+    refinedRegion = QRegion();
+}
+
+// Maps filteredImage coordinates to those of the filtered view.
+QTransform MainWindow::imageToView() const
+{
+    return QTransform::fromScale(double(previewImage.width()) / filteredImage.width(), double(previewImage.height()) / filteredImage.height());
+}
+
+// The pixels of filteredImage under rect of the filtered view.
+QRect MainWindow::viewToImage(const QRect &rect) const
+{
+    return imageToView().inverted().mapRect(QRectF(rect)).toAlignedRect().intersected(filteredImage.rect());
+}
+
+// Shows the filter on the preview at once and leaves the full-resolution
+// work to startRefinement. An image that fits the view has no separate
+// preview, so its result is committed right away.
+void MainWindow::startFilter(const FilterOperation &operation)
+{
+    QImage preview;
+    try
+    {
+        preview = filterCache.apply(operation.scaled(previewScale), previewImage);
+    }
+    catch (const std::exception &e)
+    {
+        QMessageBox::warning(this, "Error", e.what());
+        return;
+    }
+    previewImage = preview;
+    history.push(operation);
+    previewStates.resize(history.position());
+    previewStates.append(preview);
+    updateHistoryButtons();
+
+    showPreview();
+    if (previewScale >= 1.0)
+    {
+        committedState = history.position();
+        filteredImage = preview;
+        return;
+    }
+    pendingFilters.append(operation);
+    if (regionCheckBox->isChecked() && saveFileName.isEmpty())
+    {
+        // A region being refined belongs to the previous state.
+        cancelRefinement();
+        startRegionRefinement();
+    }
+    else if (!filterTask)
+    {
+        startRefinement();
+    }
+}
+
+// Applies every pending filter to filteredImage in one background job, as a
+// single FilterPipeline run. Filters added meanwhile are picked up by the
+// next job. While saving, the job stops at the saved state and the whole
+// image is refined even in region mode.
+void MainWindow::startRefinement()
+{
+    if (regionCheckBox->isChecked() && saveFileName.isEmpty())
+    {
+        startRegionRefinement();
+        return;
+    }
+    const quint64 generation = ++filterGeneration;
+    const QVector<FilterOperation> chain = saveFileName.isEmpty() ? pendingFilters : pendingFilters.mid(0, saveState - committedState);
+    const FilterPipeline pipeline(chain);
+    auto task = std::make_shared<TileScheduler::Task>(pipeline.passCount(), [this, generation](double progress)
+                                                      { QMetaObject::invokeMethod(this, [this, generation, progress]()
+                                                                                  { showFilterProgress(generation, progress); }, Qt::QueuedConnection); });
+    filterTask = task;
+
+    filterProgressBar->setValue(0);
+    filterProgressBar->show();
+    cancelFilterButton->show();
+    statusBar()->showMessage("Applying " + FilterOperation::chainToString(chain) + " at full resolution...");
+
+    const QImage source = filteredImage;
+    const QSize viewSize = previewImage.size();
+    filterPool.start([this, task, chain, pipeline, source, viewSize, generation]()
+                     {
+        QImage result;
+        QImage view;
+        QString error;
+        try
+        {
+            TileScheduler::TaskScope scope(task.get());
+            result = filterCache.apply(chain, source);
+            view = result.scaled(viewSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }
+        catch (const TileScheduler::Cancelled &)
+        {
+            return;
+        }
+        catch (const std::exception &e)
+        {
+            error = e.what();
+        }
+        const int filterCount = pipeline.operations().size();
+        QMetaObject::invokeMethod(this, [this, generation, filterCount, result, view, error]()
+                                  { finishRefinement(generation, filterCount, result, view, error); }, Qt::QueuedConnection); });
+}
+
+// view is result scaled down to the preview size, done with the filtering
+// rather than on the GUI thread.
+void MainWindow::finishRefinement(quint64 generation, int filterCount, const QImage &result, const QImage &view, const QString &error)
+{
+    if (generation != filterGeneration)
+        return;
+    filterTask.reset();
+
+    if (!error.isEmpty())
+    {
+        cancelFilter();
+        statusBar()->clearMessage();
+        QMessageBox::warning(this, "Error", error);
+        return;
+    }
+
+    filteredImage = result;
+    committedState += filterCount;
+    history.store(committedState, result);
+    // The scaled-down result shows its state more faithfully than a preview
+    // filtered with scaled kernels.
+    previewStates[committedState] = view;
+    pendingFilters.remove(0, filterCount);
+    if (pendingFilters.isEmpty())
+    {
+        filterProgressBar->hide();
+        cancelFilterButton->hide();
+        statusBar()->clearMessage();
+        previewImage = view;
+        showPreview();
+    }
+    if (!saveFileName.isEmpty() && committedState == saveState)
+        saveFilteredImage();
+    if (!pendingFilters.isEmpty())
+        startRefinement();
+}
 
-    QImage hChannel = ImageProcessor::extractChannel(hsvImage, ImageProcessor::Channel::H);
-    QImage sChannel = ImageProcessor::extractChannel(hsvImage, ImageProcessor::Channel::S);
-    QImage vChannel = ImageProcessor::extractChannel(hsvImage, ImageProcessor::Channel::V);
+QRect MainWindow::visibleImageRect() const
+{
+    return viewToImage(filteredImageLabel->visibleRegion().boundingRect());
+}
 
-    QImage rgbImage = ImageProcessor::convertHSVToRGB(hChannel, sChannel, vChannel);
+// Region mode's startRefinement: applies the pending filters at full
+// resolution to the part of the selection, or of the visible area, not
+// refined yet. One region is computed at a time; scrolling meanwhile is
+// caught up with when it finishes.
+void MainWindow::startRegionRefinement()
+{
+    if (filterTask || pendingFilters.isEmpty())
+        return;
+    const QRegion missing = QRegion(selection.isEmpty() ? visibleImageRect() : selection) - refinedRegion;
+    if (missing.isEmpty())
+        return;
 
-    HfilteredImageLabel->setPixmap(QPixmap::fromImage(hChannel).scaled(HfilteredImageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    SfilteredImageLabel->setPixmap(QPixmap::fromImage(sChannel).scaled(SfilteredImageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    VfilteredImageLabel->setPixmap(QPixmap::fromImage(vChannel).scaled(VfilteredImageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
-    RGBfilteredImageLabel->setPixmap(QPixmap::fromImage(rgbImage).scaled(RGBfilteredImageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
-}
\ No newline at end of file
+    const QRect region = missing.boundingRect();
+    const quint64 generation = ++filterGeneration;
+    const FilterPipeline pipeline(pendingFilters);
+    auto task = std::make_shared<TileScheduler::Task>(pipeline.passCount(), [this, generation](double progress)
+                                                      { QMetaObject::invokeMethod(this, [this, generation, progress]()
+                                                                                  { showFilterProgress(generation, progress); }, Qt::QueuedConnection); });
+    filterTask = task;
+
+    filterProgressBar->setValue(0);
+    filterProgressBar->show();
+    cancelFilterButton->show();
+    statusBar()->showMessage("Applying " + FilterOperation::chainToString(pendingFilters) + " to the visible area...");
+
+    const QImage source = filteredImage;
+    filterPool.start([this, task, pipeline, source, region, generation]()
+                     {
+        QImage patch;
+        QString error;
+        try
+        {
+            TileScheduler::TaskScope scope(task.get());
+            patch = pipeline.applyRegion(source, region);
+        }
+        catch (const TileScheduler::Cancelled &)
+        {
+            return;
+        }
+        catch (const std::exception &e)
+        {
+            error = e.what();
+        }
+        QMetaObject::invokeMethod(this, [this, generation, region, patch, error]()
+                                  { finishRegionRefinement(generation, region, patch, error); }, Qt::QueuedConnection); });
+}
+
+void MainWindow::finishRegionRefinement(quint64 generation, const QRect &region, const QImage &patch, const QString &error)
+{
+    if (generation != filterGeneration)
+        return;
+    filterTask.reset();
+    filterProgressBar->hide();
+    cancelFilterButton->hide();
+    statusBar()->clearMessage();
+
+    if (!error.isEmpty())
+    {
+        cancelFilter();
+        QMessageBox::warning(this, "Error", error);
+        return;
+    }
+
+    QPainter painter(&filteredPixmap);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.setTransform(imageToView());
+    painter.drawImage(region.topLeft(), patch);
+    painter.end();
+    filteredImageLabel->setPixmap(filteredPixmap);
+    refinedRegion += region;
+    startRegionRefinement();
+}
+
+// Switching modes restarts the refinement of the pending filters in the
+// other one; a save keeps refining the whole image.
+void MainWindow::setRegionMode(bool enabled)
+{
+    if (!enabled)
+    {
+        selection = QRect();
+        selectionBand->hide();
+    }
+    if (pendingFilters.isEmpty() || !saveFileName.isEmpty())
+        return;
+    cancelRefinement();
+    filterProgressBar->hide();
+    cancelFilterButton->hide();
+    statusBar()->clearMessage();
+    showPreview();
+    startRefinement();
+}
+
+void MainWindow::showFilterProgress(quint64 generation, double progress)
+{
+    if (generation == filterGeneration)
+        filterProgressBar->setValue(qRound(progress * 100));
+}
+
+// Stops the running refinement and forgets the filters it had not
+// committed, and with them a save waiting for them; the caller decides what
+// to show instead.
+void MainWindow::discardPendingFilters()
+{
+    cancelRefinement();
+    pendingFilters.clear();
+    filterProgressBar->hide();
+    cancelFilterButton->hide();
+    if (!saveFileName.isEmpty())
+    {
+        saveFileName.clear();
+        statusBar()->showMessage("Save cancelled", 2000);
+    }
+}
+
+// Stops the running refinement, keeping the pending filters; its result is
+// ignored if it still arrives.
+void MainWindow::cancelRefinement()
+{
+    if (filterTask)
+        filterTask->cancel();
+    filterTask.reset();
+    ++filterGeneration;
+}
+
+// The Cancel button: filters not yet refined are undone, leaving the last
+// full-resolution result; they can still be redone.
+void MainWindow::cancelFilter()
+{
+    if (pendingFilters.isEmpty())
+        return;
+    for (int i = pendingFilters.size(); i > 0; --i)
+        history.undo();
+    showHistoryState();
+    statusBar()->showMessage("Filter cancelled", 2000);
+}
@@ -0,0 +1,249 @@
+#include "medianfilter.h"
+#include "imagebufferpool.h"
+#include "pixelaccess.h"
+#include "tilescheduler.h"
+#include <QVector>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+    // Pixels per network evaluation; each compare-exchange runs over the
+    // whole run, which the compiler turns into packed byte min/max.
+    const int NETWORK_RUN = 64;
+
+    // Median selection networks for 9 and 25 samples (Paeth / Devillard).
+    // The first index of each pair receives the minimum.
+    const int median9Network[][2] = {
+        {1, 2}, {4, 5}, {7, 8}, {0, 1}, {3, 4}, {6, 7}, {1, 2}, {4, 5}, {7, 8}, {0, 3}, {5, 8}, {4, 7}, {3, 6}, {1, 4}, {2, 5}, {4, 7}, {4, 2}, {6, 4}, {4, 2}};
+
+    const int median25Network[][2] = {
+        {0, 1}, {3, 4}, {2, 4}, {2, 3}, {6, 7}, {5, 7}, {5, 6}, {9, 10}, {8, 10}, {8, 9}, {12, 13}, {11, 13}, {11, 12}, {15, 16}, {14, 16}, {14, 15}, {18, 19}, {17, 19}, {17, 18}, {21, 22}, {20, 22}, {20, 21}, {23, 24}, {2, 5}, {3, 6}, {0, 6}, {0, 3}, {4, 7}, {1, 7}, {1, 4}, {11, 14}, {8, 14}, {8, 11}, {12, 15}, {9, 15}, {9, 12}, {13, 16}, {10, 16}, {10, 13}, {20, 23}, {17, 23}, {17, 20}, {21, 24}, {18, 24}, {18, 21}, {19, 22}, {8, 17}, {9, 18}, {0, 18}, {0, 9}, {10, 19}, {1, 19}, {1, 10}, {11, 20}, {2, 20}, {2, 11}, {12, 21}, {3, 21}, {3, 12}, {13, 22}, {4, 22}, {4, 13}, {14, 23}, {5, 23}, {5, 14}, {15, 24}, {6, 24}, {6, 15}, {7, 16}, {7, 19}, {13, 21}, {15, 23}, {7, 13}, {7, 15}, {1, 9}, {3, 11}, {5, 17}, {11, 17}, {9, 17}, {4, 10}, {6, 12}, {7, 14}, {4, 6}, {4, 7}, {12, 14}, {10, 14}, {6, 7}, {10, 12}, {6, 10}, {6, 17}, {12, 17}, {7, 17}, {7, 10}, {12, 18}, {7, 12}, {10, 18}, {12, 20}, {10, 20}, {10, 12}};
+
+    struct Network
+    {
+        const int (*pairs)[2];
+        int pairCount;
+    };
+
+    inline void sortPair(uchar *__restrict low, uchar *__restrict high)
+    {
+        for (int i = 0; i < NETWORK_RUN; ++i)
+        {
+            const uchar a = low[i];
+            const uchar b = high[i];
+            low[i] = a < b ? a : b;
+            high[i] = a < b ? b : a;
+        }
+    }
+
+    // windowRows[ky] points at the padded plane row of window row ky, so
+    // output pixel x reads windowRows[ky][x + kx].
+    void networkMedianRow(const uchar *const *windowRows, int kernelSize, const Network &network, uchar *out, int width)
+    {
+        // A short final run still sorts whole rows; the unused tail is
+        // zeroed once so the extra lanes only ever see defined values.
+        uchar samples[MedianFilter::LARGEST_NETWORK_SIZE * MedianFilter::LARGEST_NETWORK_SIZE][NETWORK_RUN] = {};
+        const int medianIndex = kernelSize * kernelSize / 2;
+        for (int start = 0; start < width; start += NETWORK_RUN)
+        {
+            const int count = qMin(NETWORK_RUN, width - start);
+            for (int ky = 0; ky < kernelSize; ++ky)
+            {
+                for (int kx = 0; kx < kernelSize; ++kx)
+                    std::memcpy(samples[ky * kernelSize + kx], windowRows[ky] + start + kx, count);
+            }
+            for (int i = 0; i < network.pairCount; ++i)
+                sortPair(samples[network.pairs[i][0]], samples[network.pairs[i][1]]);
+            std::memcpy(out + start, samples[medianIndex], count);
+        }
+    }
+
+    // Huang's sliding histogram: moving one pixel right removes the leaving
+    // column and adds the entering one, and the median is walked from its
+    // previous position using the count of samples below it.
+    void histogramMedianRow(const uchar *const *windowRows, int kernelSize, uchar *out, int width)
+    {
+        const int medianIndex = kernelSize * kernelSize / 2;
+        int histogram[256] = {0};
+        for (int ky = 0; ky < kernelSize; ++ky)
+        {
+            for (int kx = 0; kx < kernelSize; ++kx)
+                ++histogram[windowRows[ky][kx]];
+        }
+
+        int median = 0;
+        int below = 0;
+        for (int x = 0; x < width; ++x)
+        {
+            if (x > 0)
+            {
+                for (int ky = 0; ky < kernelSize; ++ky)
+                {
+                    const int removed = windowRows[ky][x - 1];
+                    const int added = windowRows[ky][x - 1 + kernelSize];
+                    --histogram[removed];
+                    ++histogram[added];
+                    below += (added < median) - (removed < median);
+                }
+            }
+            while (below > medianIndex)
+                below -= histogram[--median];
+            while (below + histogram[median] <= medianIndex)
+                below += histogram[median++];
+            out[x] = static_cast<uchar>(median);
+        }
+    }
+
+    Network networkFor(int kernelSize)
+    {
+        if (kernelSize == 3)
+            return {median9Network, static_cast<int>(std::size(median9Network))};
+        if (kernelSize == 5)
+            return {median25Network, static_cast<int>(std::size(median25Network))};
+        return {nullptr, 0};
+    }
+
+    // Medians of rows [firstRow, lastRow) of an image width pixels wide.
+    // loadRow(y, padLeft, paddedWidth, red, green, blue) fills the padded
+    // planes of source row y, resolving rows above and below the image
+    // through the border, outputRow(y, channel) is where the medians of one
+    // channel of result row y go and finishRow(y) is called once all three
+    // are there.
+    template <typename LoadRow, typename OutputRow, typename FinishRow>
+    void medianBand(int width, int kernelSize, int firstRow, int lastRow, LoadRow loadRow, OutputRow outputRow, FinishRow finishRow)
+    {
+        const int halfKernelSize = kernelSize / 2;
+        const int paddedWidth = width + kernelSize - 1;
+        const Network network = networkFor(kernelSize);
+
+        const int sourceRows = lastRow - firstRow + kernelSize - 1;
+        const qsizetype planeRowBytes = qsizetype(3) * paddedWidth;
+        ImageBufferPool::Scratch<uchar> planes(sourceRows * planeRowBytes);
+        for (int i = 0; i < sourceRows; ++i)
+        {
+            uchar *red = planes.data() + i * planeRowBytes;
+            loadRow(firstRow - halfKernelSize + i, halfKernelSize, paddedWidth, red, red + paddedWidth, red + 2 * paddedWidth);
+        }
+
+        QVector<const uchar *> windowRows(kernelSize);
+        for (int y = firstRow; y < lastRow; ++y)
+        {
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                for (int ky = 0; ky < kernelSize; ++ky)
+                    windowRows[ky] = planes.constData() + (y - firstRow + ky) * planeRowBytes + channel * paddedWidth;
+
+                uchar *out = outputRow(y, channel);
+                if (network.pairs)
+                    networkMedianRow(windowRows.constData(), kernelSize, network, out, width);
+                else
+                    histogramMedianRow(windowRows.constData(), kernelSize, out, width);
+            }
+            finishRow(y);
+        }
+    }
+}
+
+QImage MedianFilter::apply(const QImage &image, int kernelSize, const Border &border)
+{
+    const QImage source = PixelAccess::normalized(image);
+    QImage result = PixelAccess::createResult(source.size());
+    const PixelAccess::RowWriter<QRgb> resultRows = PixelAccess::rows(result);
+    const int width = source.width();
+    const int height = source.height();
+
+    if (kernelSize <= 1)
+    {
+        TileScheduler::forEachBand(height, 0, [&](int firstRow, int lastRow)
+                                   {
+            for (int y = firstRow; y < lastRow; ++y)
+            {
+                const QRgb *src = PixelAccess::constRow(source, y);
+                QRgb *dst = resultRows(y);
+                for (int x = 0; x < width; ++x)
+                    dst[x] = src[x] | 0xff000000u;
+            } });
+        return result;
+    }
+
+    TileScheduler::forEachBand(height, kernelSize / 2, [&](int firstRow, int lastRow)
+                               { filterRows([&source](int y)
+                                            { return PixelAccess::constRow(source, y); },
+                                            resultRows, width, height, kernelSize, border, firstRow, lastRow); });
+    return result;
+}
+
+QImage MedianFilter::apply(QImage &&image, int kernelSize, const Border &border)
+{
+    if ((kernelSize > 1 && !border.isLocal()) || !PixelAccess::prepareInPlace(image))
+        return apply(static_cast<const QImage &>(image), kernelSize, border);
+
+    const int width = image.width();
+    const int height = image.height();
+    if (kernelSize <= 1)
+    {
+        const PixelAccess::RowWriter<QRgb> imageRows = PixelAccess::rows(image);
+        TileScheduler::forEachBand(height, 0, [&](int firstRow, int lastRow)
+                                   {
+            for (int y = firstRow; y < lastRow; ++y)
+            {
+                QRgb *row = imageRows(y);
+                for (int x = 0; x < width; ++x)
+                    row[x] |= 0xff000000u;
+            } });
+        return std::move(image);
+    }
+
+    const int halfKernelSize = kernelSize / 2;
+    PixelAccess::filterInPlace(image, halfKernelSize, halfKernelSize,
+                               [&](const PixelAccess::ConstRowFunction &sourceRow, const PixelAccess::RowFunction &resultRow, int firstRow,
+                                   int lastRow)
+                               { filterRows(sourceRow, resultRow, width, height, kernelSize, border, firstRow, lastRow); });
+    return std::move(image);
+}
+
+void MedianFilter::filterRows(const PixelAccess::ConstRowFunction &sourceRow, const PixelAccess::RowFunction &resultRow, int width, int height,
+                              int kernelSize, const Border &border, int firstRow, int lastRow)
+{
+    ImageBufferPool::Scratch<uchar> medians(3 * width);
+    medianBand(
+        width, kernelSize, firstRow, lastRow,
+        [&sourceRow, &border, width, height](int y, int padLeft, int paddedWidth, uchar *red, uchar *green, uchar *blue)
+        {
+            const int row = border.map(y, height);
+            PixelAccess::splitPaddedRow(row < 0 ? nullptr : sourceRow(row), width, padLeft, paddedWidth, red, green, blue, border);
+        },
+        [&medians, width](int, int channel)
+        { return medians.data() + channel * width; },
+        [&](int y)
+        {
+            QRgb *dst = resultRow(y);
+            for (int x = 0; x < width; ++x)
+                dst[x] = qRgb(medians[x], medians[width + x], medians[2 * width + x]);
+        });
+}
+
+PlanarImage MedianFilter::apply(const PlanarImage &image, int kernelSize, const Border &border)
+{
+    if (kernelSize <= 1)
+        return image;
+
+    PlanarImage result(image.size());
+    const int width = image.width();
+    const int height = image.height();
+    TileScheduler::forEachBand(height, kernelSize / 2, [&](int firstRow, int lastRow)
+                               { medianBand(
+                                     width, kernelSize, firstRow, lastRow,
+                                     [&image, &border, width, height](int y, int padLeft, int paddedWidth, uchar *red, uchar *green, uchar *blue)
+                                     {
+                                         const int row = border.map(y, height);
+                                         PixelAccess::padRow(row < 0 ? nullptr : image.constRow(0, row), width, padLeft, paddedWidth, red, border);
+                                         PixelAccess::padRow(row < 0 ? nullptr : image.constRow(1, row), width, padLeft, paddedWidth, green, border);
+                                         PixelAccess::padRow(row < 0 ? nullptr : image.constRow(2, row), width, padLeft, paddedWidth, blue, border);
+                                     },
+                                     [&result](int y, int channel)
+                                     { return result.row(channel, y); },
+                                     [](int) {}); });
+    return result;
+}
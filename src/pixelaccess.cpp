@@ -0,0 +1,148 @@
+#include "pixelaccess.h"
+#include "imagebufferpool.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // Target size of the strips filterInPlace() computes at a time.
+    const int IN_PLACE_STRIP_BYTES = 256 * 1024;
+}
+
+QImage PixelAccess::normalized(const QImage &image)
+{
+    // RGB32 shares the ARGB32 memory layout (alpha fixed at 0xff), so it can
+    // be read without a conversion pass.
+    if (image.format() == WorkingFormat || image.format() == QImage::Format_RGB32)
+        return image;
+    return image.convertToFormat(WorkingFormat);
+}
+
+QImage PixelAccess::createResult(const QSize &size)
+{
+    return ImageBufferPool::createImage(size, WorkingFormat);
+}
+
+void PixelAccess::splitPaddedRow(const QRgb *src, int width, int padLeft, int paddedWidth, uchar *red, uchar *green, uchar *blue,
+                                 const Border &border)
+{
+    if (!src)
+    {
+        std::fill(red, red + paddedWidth, static_cast<uchar>(border.value()));
+        std::fill(green, green + paddedWidth, static_cast<uchar>(border.value()));
+        std::fill(blue, blue + paddedWidth, static_cast<uchar>(border.value()));
+        return;
+    }
+
+    const int right = qMin(paddedWidth, padLeft + width);
+    for (int i = padLeft; i < right; ++i)
+    {
+        const QRgb pixel = src[i - padLeft];
+        red[i] = static_cast<uchar>(qRed(pixel));
+        green[i] = static_cast<uchar>(qGreen(pixel));
+        blue[i] = static_cast<uchar>(qBlue(pixel));
+    }
+
+    const QRgb constant = qRgb(border.value(), border.value(), border.value());
+    auto padPixel = [&](int i)
+    {
+        const int x = border.map(i - padLeft, width);
+        const QRgb pixel = x < 0 ? constant : src[x];
+        red[i] = static_cast<uchar>(qRed(pixel));
+        green[i] = static_cast<uchar>(qGreen(pixel));
+        blue[i] = static_cast<uchar>(qBlue(pixel));
+    };
+    for (int i = 0; i < padLeft; ++i)
+        padPixel(i);
+    for (int i = right; i < paddedWidth; ++i)
+        padPixel(i);
+}
+
+void PixelAccess::padRow(const uchar *src, int width, int padLeft, int paddedWidth, uchar *dst, const Border &border)
+{
+    if (!src)
+    {
+        std::fill(dst, dst + paddedWidth, static_cast<uchar>(border.value()));
+        return;
+    }
+
+    const int right = qMin(paddedWidth, padLeft + width);
+    std::copy(src, src + (right - padLeft), dst + padLeft);
+    for (int i = 0; i < padLeft; ++i)
+    {
+        const int x = border.map(i - padLeft, width);
+        dst[i] = x < 0 ? static_cast<uchar>(border.value()) : src[x];
+    }
+    for (int i = right; i < paddedWidth; ++i)
+    {
+        const int x = border.map(i - padLeft, width);
+        dst[i] = x < 0 ? static_cast<uchar>(border.value()) : src[x];
+    }
+}
+
+bool PixelAccess::prepareInPlace(QImage &image)
+{
+    if (image.isNull() || !image.isDetached())
+        return false;
+    if (image.format() == QImage::Format_RGB32)
+        return image.reinterpretAsFormat(WorkingFormat);
+    return image.format() == WorkingFormat;
+}
+
+void PixelAccess::filterInPlace(QImage &image, int haloAbove, int haloBelow, const RowsFunction &function)
+{
+    const int width = image.width();
+    const int height = image.height();
+    const RowWriter<QRgb> imageRows = rows(image);
+    const size_t rowBytes = size_t(width) * sizeof(QRgb);
+    const int bandRows = TileScheduler::bandRows(height, qMax(haloAbove, haloBelow));
+    const int stripRows = qMax(qMax(1, haloAbove + haloBelow), IN_PLACE_STRIP_BYTES / qMax(1, int(rowBytes)));
+
+    // Boundary k (at row k * bandRows) keeps rows [-haloAbove, haloBelow)
+    // around it, read by the bands on both sides.
+    const int edgeRows = haloAbove + haloBelow;
+    const int boundaries = (height - 1) / bandRows;
+    ImageBufferPool::Scratch<QRgb> edges(qsizetype(boundaries) * edgeRows * width);
+    auto edgeRow = [&](int boundary, int i)
+    { return edges.data() + (qsizetype(boundary - 1) * edgeRows + i) * width; };
+    for (int boundary = 1; boundary <= boundaries; ++boundary)
+    {
+        for (int i = 0; i < edgeRows; ++i)
+        {
+            const int y = boundary * bandRows - haloAbove + i;
+            if (y < height)
+                std::memcpy(edgeRow(boundary, i), imageRows(y), rowBytes);
+        }
+    }
+
+    TileScheduler::forEachBandOf(height, bandRows, [&](int firstRow, int lastRow)
+                                 {
+        ImageBufferPool::Scratch<QRgb> history(qsizetype(haloAbove) * width);
+        ImageBufferPool::Scratch<QRgb> strip(qsizetype(stripRows) * width);
+        int stripFirst = firstRow;
+        const ConstRowFunction sourceRow = [&](int y) -> const QRgb *
+        {
+            if (y < firstRow)
+                return edgeRow(firstRow / bandRows, y - firstRow + haloAbove);
+            if (y >= lastRow)
+                return edgeRow(lastRow / bandRows, y - lastRow + haloAbove);
+            if (y < stripFirst)
+                return history.constData() + qsizetype(y % haloAbove) * width;
+            return imageRows(y);
+        };
+        const RowFunction stripRow = [&](int y)
+        { return strip.data() + qsizetype(y - stripFirst) * width; };
+
+        for (; stripFirst < lastRow; stripFirst += stripRows)
+        {
+            const int stripLast = qMin(stripFirst + stripRows, lastRow);
+            function(sourceRow, stripRow, stripFirst, stripLast);
+            if (haloAbove > 0)
+            {
+                for (int y = qMax(stripFirst, stripLast - haloAbove); y < stripLast; ++y)
+                    std::memcpy(history.data() + qsizetype(y % haloAbove) * width, imageRows(y), rowBytes);
+            }
+            for (int y = stripFirst; y < stripLast; ++y)
+                std::memcpy(imageRows(y), stripRow(y), rowBytes);
+        } });
+}
@@ -0,0 +1,135 @@
+#include "planarimage.h"
+#include "imagebufferpool.h"
+#include "pixelaccess.h"
+#include "tilescheduler.h"
+#include <algorithm>
+
+static_assert(PlanarImage::ALIGNMENT <= ImageBufferPool::ALIGNMENT, "plane rows must stay aligned");
+
+namespace
+{
+    // Planes live in an ImageBufferPool block, returned when the last copy
+    // or view lets go of it.
+    std::shared_ptr<uchar> allocatePlanes(qsizetype bytes)
+    {
+        const ImageBufferPool::Block block = ImageBufferPool::acquire(bytes);
+        return std::shared_ptr<uchar>(block.data, [block](uchar *)
+                                      { ImageBufferPool::release(block); });
+    }
+
+    // Cleanup function of plane() views: drops the buffer reference they hold.
+    void releaseView(void *info)
+    {
+        delete static_cast<std::shared_ptr<uchar> *>(info);
+    }
+}
+
+PlanarImage::PlanarImage()
+{
+}
+
+PlanarImage::PlanarImage(const QSize &size)
+{
+    if (size.isEmpty())
+        return;
+    planeColumns = size.width();
+    planeRows = size.height();
+    rowStride = (planeColumns + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    buffer = allocatePlanes(CHANNELS * planeRows * rowStride);
+    pixels = buffer.get();
+}
+
+PlanarImage PlanarImage::fromImage(const QImage &image)
+{
+    const QImage source = PixelAccess::normalized(image);
+    PlanarImage planes(source.size());
+    if (planes.isNull())
+        return planes;
+    const int width = planes.width();
+    TileScheduler::forEachBand(planes.height(), 0, [&](int firstRow, int lastRow)
+                               {
+        for (int y = firstRow; y < lastRow; ++y)
+        {
+            const QRgb *src = PixelAccess::constRow(source, y);
+            uchar *red = planes.row(0, y);
+            uchar *green = planes.row(1, y);
+            uchar *blue = planes.row(2, y);
+            for (int x = 0; x < width; ++x)
+            {
+                red[x] = static_cast<uchar>(src[x] >> 16);
+                green[x] = static_cast<uchar>(src[x] >> 8);
+                blue[x] = static_cast<uchar>(src[x]);
+            }
+        } });
+    return planes;
+}
+
+QImage PlanarImage::toImage() const
+{
+    if (isNull())
+        return QImage();
+    QImage image = PixelAccess::createResult(size());
+    const PixelAccess::RowWriter<QRgb> imageRows = PixelAccess::rows(image);
+    TileScheduler::forEachBand(planeRows, 0, [&](int firstRow, int lastRow)
+                               {
+        for (int y = firstRow; y < lastRow; ++y)
+        {
+            const uchar *red = constRow(0, y);
+            const uchar *green = constRow(1, y);
+            const uchar *blue = constRow(2, y);
+            QRgb *dst = imageRows(y);
+            for (int x = 0; x < planeColumns; ++x)
+                dst[x] = 0xff000000u | (QRgb(red[x]) << 16) | (QRgb(green[x]) << 8) | blue[x];
+        } });
+    return image;
+}
+
+bool PlanarImage::isNull() const
+{
+    return !buffer;
+}
+
+int PlanarImage::width() const
+{
+    return planeColumns;
+}
+
+int PlanarImage::height() const
+{
+    return planeRows;
+}
+
+QSize PlanarImage::size() const
+{
+    return QSize(planeColumns, planeRows);
+}
+
+qsizetype PlanarImage::stride() const
+{
+    return rowStride;
+}
+
+uchar *PlanarImage::row(int channel, int y)
+{
+    detach();
+    return pixels + (channel * planeRows + y) * rowStride;
+}
+
+QImage PlanarImage::plane(int channel) const
+{
+    if (isNull())
+        return QImage();
+    return QImage(constRow(channel, 0), planeColumns, planeRows, rowStride, QImage::Format_Grayscale8, releaseView,
+                  new std::shared_ptr<uchar>(buffer));
+}
+
+void PlanarImage::detach()
+{
+    if (buffer.use_count() <= 1)
+        return;
+    const qsizetype bytes = CHANNELS * planeRows * rowStride;
+    std::shared_ptr<uchar> copy = allocatePlanes(bytes);
+    std::copy(pixels, pixels + bytes, copy.get());
+    buffer = copy;
+    pixels = buffer.get();
+}
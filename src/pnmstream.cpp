@@ -0,0 +1,170 @@
+#include "pnmstream.h"
+#include "imagebufferpool.h"
+#include "pixelaccess.h"
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    char readChar(QFile &file)
+    {
+        char c = 0;
+        if (file.read(&c, 1) != 1)
+            throw std::runtime_error("Unexpected end of PNM header in " + file.fileName().toStdString());
+        return c;
+    }
+
+    // Reads a decimal header field, skipping whitespace and comments before
+    // it. The single whitespace character ending the field is consumed, as
+    // the format requires after the last one.
+    int readField(QFile &file)
+    {
+        char c = readChar(file);
+        while (isSpace(c) || c == '#')
+        {
+            if (c == '#')
+            {
+                while (c != '\n' && c != '\r')
+                    c = readChar(file);
+            }
+            c = readChar(file);
+        }
+        if (c < '0' || c > '9')
+            throw std::runtime_error("Malformed PNM header in " + file.fileName().toStdString());
+        qint64 value = 0;
+        while (c >= '0' && c <= '9')
+        {
+            value = value * 10 + (c - '0');
+            if (value > std::numeric_limits<int>::max())
+                throw std::runtime_error("PNM header value too large in " + file.fileName().toStdString());
+            c = readChar(file);
+        }
+        if (!isSpace(c))
+            throw std::runtime_error("Malformed PNM header in " + file.fileName().toStdString());
+        return int(value);
+    }
+}
+
+PnmReader::PnmReader(const QString &path)
+    : file(path)
+{
+    if (!file.open(QIODevice::ReadOnly))
+        throw std::runtime_error("Could not open " + path.toStdString());
+    char magic[2];
+    if (file.read(magic, 2) != 2 || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6'))
+        throw std::runtime_error(path.toStdString() + " is not a binary PGM or PPM file");
+    channels = magic[1] == '5' ? 1 : 3;
+    const int width = readField(file);
+    const int height = readField(file);
+    const int maxValue = readField(file);
+    if (width < 1 || height < 1)
+        throw std::runtime_error(path.toStdString() + " has no pixels");
+    if (maxValue != 255)
+        throw std::runtime_error(path.toStdString() + " does not have 8-bit samples");
+    imageSize = QSize(width, height);
+}
+
+QSize PnmReader::size() const
+{
+    return imageSize;
+}
+
+bool PnmReader::isGrey() const
+{
+    return channels == 1;
+}
+
+QImage PnmReader::readRows(int rowCount)
+{
+    if (rowCount < 0 || nextRow + rowCount > imageSize.height())
+        throw std::runtime_error("Reading past the last row of " + file.fileName().toStdString());
+    const int width = imageSize.width();
+    const qint64 rowBytes = qint64(width) * channels;
+    const QSize size(width, rowCount);
+    QImage rows = isGrey() ? ImageBufferPool::createImage(size, QImage::Format_Grayscale8) : PixelAccess::createResult(size);
+    ImageBufferPool::Scratch<uchar> samples(isGrey() ? 0 : rowBytes);
+    for (int y = 0; y < rowCount; ++y)
+    {
+        uchar *line = isGrey() ? rows.scanLine(y) : samples.data();
+        if (file.read(reinterpret_cast<char *>(line), rowBytes) != rowBytes)
+            throw std::runtime_error("Unexpected end of pixel data in " + file.fileName().toStdString());
+        if (isGrey())
+            continue;
+        QRgb *dst = reinterpret_cast<QRgb *>(rows.scanLine(y));
+        for (int x = 0; x < width; ++x)
+            dst[x] = qRgb(line[3 * x], line[3 * x + 1], line[3 * x + 2]);
+    }
+    nextRow += rowCount;
+    return rows;
+}
+
+PnmWriter::PnmWriter(const QString &path, const QSize &size, bool grey)
+    : file(path), imageSize(size), channels(grey ? 1 : 3)
+{
+    if (size.isEmpty())
+        throw std::runtime_error("Cannot write an empty image to " + path.toStdString());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        throw std::runtime_error("Could not write " + path.toStdString());
+    const std::string header = std::string(grey ? "P5" : "P6") + "\n" + std::to_string(size.width()) + " " +
+                               std::to_string(size.height()) + "\n255\n";
+    if (file.write(header.data(), qint64(header.size())) != qint64(header.size()))
+        throw std::runtime_error("Could not write " + path.toStdString());
+}
+
+void PnmWriter::writeRows(const QImage &image, int firstRow, int rowCount)
+{
+    if (image.width() != imageSize.width() || nextRow + rowCount > imageSize.height())
+        throw std::runtime_error("Rows do not fit the image being written to " + file.fileName().toStdString());
+    const int width = imageSize.width();
+    const qint64 rowBytes = qint64(width) * channels;
+    const bool greyRows = image.format() == QImage::Format_Grayscale8;
+    const QImage source = greyRows ? image : PixelAccess::normalized(image);
+    ImageBufferPool::Scratch<uchar> samples(rowBytes);
+    for (int y = firstRow; y < firstRow + rowCount; ++y)
+    {
+        const uchar *line = source.constScanLine(y);
+        uchar *out = samples.data();
+        if (greyRows)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                for (int c = 0; c < channels; ++c)
+                    out[channels * x + c] = line[x];
+            }
+        }
+        else
+        {
+            const QRgb *src = reinterpret_cast<const QRgb *>(line);
+            for (int x = 0; x < width; ++x)
+            {
+                if (channels == 1)
+                {
+                    out[x] = static_cast<uchar>(qGray(src[x]));
+                    continue;
+                }
+                out[3 * x] = static_cast<uchar>(qRed(src[x]));
+                out[3 * x + 1] = static_cast<uchar>(qGreen(src[x]));
+                out[3 * x + 2] = static_cast<uchar>(qBlue(src[x]));
+            }
+        }
+        if (file.write(reinterpret_cast<const char *>(out), rowBytes) != rowBytes)
+            throw std::runtime_error("Could not write " + file.fileName().toStdString());
+    }
+    nextRow += rowCount;
+}
+
+void PnmWriter::finish()
+{
+    file.close();
+    if (nextRow != imageSize.height())
+        throw std::runtime_error("Only " + std::to_string(nextRow) + " of " + std::to_string(imageSize.height()) + " rows written to " +
+                                 file.fileName().toStdString());
+    if (file.error() != QFileDevice::NoError)
+        throw std::runtime_error("Could not write " + file.fileName().toStdString());
+}
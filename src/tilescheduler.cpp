@@ -0,0 +1,211 @@
+#include "tilescheduler.h"
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <utility>
+
+namespace
+{
+    const int MIN_BAND_ROWS = 16;
+    const int BANDS_PER_THREAD = 4;
+    // Bands per pass when a task is watching, so cancellation and progress
+    // stay responsive even on few threads.
+    const int TASK_BANDS = 64;
+
+    std::atomic<int> configuredThreadCount{0};
+    thread_local TileScheduler::Task *currentTask = nullptr;
+
+    QThreadPool *pool()
+    {
+        static QThreadPool instance;
+        return &instance;
+    }
+
+    struct BandQueue
+    {
+        TileScheduler::BandFunction function;
+        TileScheduler::Task *task = nullptr;
+        int rows = 0;
+        int bandRows = 0;
+        int bandCount = 0;
+        std::atomic<int> nextBand{0};
+        int finishedBands = 0;
+        std::exception_ptr error;
+        QMutex mutex;
+        QWaitCondition allFinished;
+    };
+
+    void runBand(TileScheduler::Task *task, const TileScheduler::BandFunction &function, int firstRow, int lastRow)
+    {
+        if (task && task->isCancelled())
+            throw TileScheduler::Cancelled();
+        function(firstRow, lastRow);
+        if (task)
+            task->finishRows(lastRow - firstRow);
+    }
+
+    // Claims bands until none are left. Both the pool workers and the calling
+    // thread drain the same queue, so a caller that is itself running on a
+    // pool thread can never deadlock waiting for helpers that never start.
+    void drain(BandQueue &queue)
+    {
+        TileScheduler::TaskScope scope(queue.task);
+        for (int band = queue.nextBand++; band < queue.bandCount; band = queue.nextBand++)
+        {
+            const int firstRow = band * queue.bandRows;
+            const int lastRow = qMin(firstRow + queue.bandRows, queue.rows);
+            std::exception_ptr error;
+            try
+            {
+                runBand(queue.task, queue.function, firstRow, lastRow);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            QMutexLocker locker(&queue.mutex);
+            if (error && !queue.error)
+                queue.error = error;
+            if (++queue.finishedBands == queue.bandCount)
+                queue.allFinished.wakeAll();
+        }
+    }
+}
+
+TileScheduler::Cancelled::Cancelled()
+    : std::runtime_error("Filter cancelled")
+{
+}
+
+TileScheduler::Task::Task(int passes, ProgressFunction onProgress)
+    : passes(qMax(1, passes)), onProgress(std::move(onProgress))
+{
+}
+
+void TileScheduler::Task::cancel()
+{
+    cancelled = true;
+}
+
+bool TileScheduler::Task::isCancelled() const
+{
+    return cancelled;
+}
+
+double TileScheduler::Task::progress() const
+{
+    const int started = startedPasses;
+    if (started == 0)
+        return 0.0;
+    const int rows = passRows;
+    const double passFraction = rows > 0 ? static_cast<double>(finishedPassRows) / rows : 1.0;
+    return qMin(1.0, (started - 1 + passFraction) / passes);
+}
+
+void TileScheduler::Task::beginPass(int rows)
+{
+    finishedPassRows = 0;
+    passRows = rows;
+    ++startedPasses;
+}
+
+void TileScheduler::Task::finishRows(int rows)
+{
+    finishedPassRows += rows;
+    if (onProgress)
+        onProgress(progress());
+}
+
+TileScheduler::TaskScope::TaskScope(Task *task)
+    : previous(currentTask)
+{
+    currentTask = task;
+}
+
+TileScheduler::TaskScope::~TaskScope()
+{
+    currentTask = previous;
+}
+
+void TileScheduler::setThreadCount(int count)
+{
+    configuredThreadCount = qMax(0, count);
+    pool()->setMaxThreadCount(qMax(1, threadCount() - 1));
+}
+
+int TileScheduler::threadCount()
+{
+    const int count = configuredThreadCount;
+    return count > 0 ? count : qMax(1, QThread::idealThreadCount());
+}
+
+int TileScheduler::bandRows(int rows, int haloRows)
+{
+    const int threads = threadCount();
+    const int minBandRows = qMax(MIN_BAND_ROWS, 4 * haloRows);
+    int bandRows = (rows + threads * BANDS_PER_THREAD - 1) / (threads * BANDS_PER_THREAD);
+    if (currentTask)
+        bandRows = qMin(bandRows, (rows + TASK_BANDS - 1) / TASK_BANDS);
+    return qMax(bandRows, minBandRows);
+}
+
+void TileScheduler::forEachBand(int rows, int haloRows, const BandFunction &function)
+{
+    forEachBandOf(rows, bandRows(rows, haloRows), function);
+}
+
+void TileScheduler::forEachBandOf(int rows, int bandRows, const BandFunction &function)
+{
+    if (rows <= 0)
+        return;
+
+    Task *task = currentTask;
+    if (task)
+    {
+        if (task->isCancelled())
+            throw Cancelled();
+        task->beginPass(rows);
+    }
+
+    const int threads = threadCount();
+    const int bandCount = (rows + bandRows - 1) / bandRows;
+
+    if (threads == 1 || bandCount == 1)
+    {
+        // Without a task one call is cheapest; with one, bands still run one
+        // at a time so cancellation and progress keep their granularity.
+        if (!task)
+        {
+            function(0, rows);
+            return;
+        }
+        for (int firstRow = 0; firstRow < rows; firstRow += bandRows)
+            runBand(task, function, firstRow, qMin(firstRow + bandRows, rows));
+        return;
+    }
+
+    auto queue = std::make_shared<BandQueue>();
+    queue->function = function;
+    queue->task = task;
+    queue->rows = rows;
+    queue->bandRows = bandRows;
+    queue->bandCount = bandCount;
+
+    const int helpers = qMin(threads, bandCount) - 1;
+    for (int i = 0; i < helpers; ++i)
+        pool()->start([queue]()
+                      { drain(*queue); });
+
+    drain(*queue);
+
+    QMutexLocker locker(&queue->mutex);
+    while (queue->finishedBands < queue->bandCount)
+        queue->allFinished.wait(&queue->mutex);
+    if (queue->error)
+        std::rethrow_exception(queue->error);
+}